@@ -0,0 +1,2 @@
+rm a.out
+g++ -O2 -std=c++14 -pthread main.cpp -lopenal
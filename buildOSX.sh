@@ -1,2 +1,2 @@
 rm a.out
-clang++ -O0 -g -std=c++11 -Xlinker -framework OpenAl main.cpp
+clang++ -O0 -g -std=c++14 -Xlinker -framework OpenAl main.cpp
@@ -10,20 +10,81 @@
 #include <cassert>
 #include <vector>
 #include <fstream>
+#include <sstream>
 #include <cstdint>
-
-// TODO(moritz): This ALubyte business is annoying. Just move all computation to float?
-//  Does OpenAL support float buffers?
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <algorithm>
+#include <complex>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <functional>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#endif
 
 
 ALCdevice *g_device = nullptr;
 ALCcontext *g_context = nullptr;
+// NOTE: Every name other than squareWave and sawtoothWave means sineWave.
+enum class Generator {
+    SquareWave,
+    SawtoothWave,
+    SineWave
+};
+
+enum class SampleFormat {
+    Unsigned8,
+    Signed16,
+    Float32
+};
+
 ALuint g_sources[2];
 ALuint g_buffers[2];
 const int g_samplingFrequency = 8000;
 bool g_doLog = true;
-std::string g_generator = "squareWave";
+Generator g_generator = Generator::SquareWave;
+int g_threadCount = 1;
+SampleFormat g_sampleFormat = SampleFormat::Signed16;
+std::string g_engine = "direct";
+std::string g_cacheDirectory = "pcmcache";
+std::uint64_t g_cacheByteLimit = 256ull << 20;
+std::uint64_t g_alBufferByteLimit = 16ull << 20;
+
+
+Generator parseGenerator(const std::string &name) {
+    if (name == "squareWave") {
+        return Generator::SquareWave;
+    } else if (name == "sawtoothWave") {
+        return Generator::SawtoothWave;
+    } else {
+        return Generator::SineWave;
+    }
+}
 
+std::string generatorName(const Generator &generator) {
+    switch (generator) {
+        case Generator::SquareWave:
+            return "squareWave";
+        case Generator::SawtoothWave:
+            return "sawtoothWave";
+        default:
+            return "sineWave";
+    }
+}
 
 void printAlError(const ALenum &error, const std::string &context = "default") {
     if (!g_doLog) {
@@ -87,118 +148,957 @@ void printAlcError(const ALCenum &error, const std::string &context = "default")
     std::cout << "[" << context << "] Error: " << errorText << "(" << error << ")" << std::endl; 
 }
 
-ALubyte computeSampleValueSquareWave(const int &sample, const int &samplingFrequency,
-                                     const float &amplitude, const float &signalFrequency,
-                                     const float &phase, const float &offset) {
-    const float t = (float)sample / (float)samplingFrequency;
-    const float sinval = std::sin(2.f*M_PI*signalFrequency*t + phase) + offset;
-    const float sign = std::copysign(1.f, sinval);
-    float sampleValue = sign < 0 ? 0.f : 255.f;
-    return sampleValue * amplitude;
+// NOTE: Shared by direct evaluation and Oscillator. Samples stay float in [-1, 1] until quantizeSamples.
+// -0 counts as high like +0, a sine rounded to zero is on the crossing either way
+constexpr float squareWaveValue(const float &amplitude, const float &sinval) {
+    return sinval < 0.0f ? -1.f : 2.f*amplitude - 1.f;
 }
 
-ALubyte computeSampleValueSawtoothWave(const int &sample, const int &samplingFrequency,
-                                       const float &amplitude, const float &signalFrequency,
-                                       const float &phase, const float &offset) {
-    const float t = (float)sample / (float)samplingFrequency + phase;
-    const float period = 1.0 / signalFrequency;
-    
-    return (ALubyte) amplitude * ((2.0f * (t/period - std::floor(0.5f + t/period)) + 1.0f) / 2.0f * 255.0f) + offset;
+// std::floor for floats that fit a long long, usable at compile time
+constexpr float constexprFloor(const float &value) {
+    const float truncated = (float)(long long)value;
+    return truncated > value ? truncated - 1.0f : truncated;
 }
 
-ALubyte computeSampleValueSineWave(const int &sample, const int &samplingFrequency,
-                                   const float &amplitude, const float &signalFrequency,
-                                   const float &phase, const float &offset) {
-    const float t = (float)sample / (float)samplingFrequency;
+constexpr float sawtoothWaveValue(const float &amplitude, const float &cycle, const float &offset) {
+    const float rising = (2.0f * (cycle - constexprFloor(0.5f + cycle)) + 1.0f) / 2.0f;
+    // offset used to be added to the 8 bit value, keep it on that scale
+    return 2.0f * (amplitude * rising + offset / 255.0f) - 1.0f;
+}
 
+constexpr float sineWaveValue(const float &amplitude, const double &sine, const float &offset) {
     // I'm kind of expecting:
     //   0.0f <= amplitude <= 1.0f
     //   -1.0f <= offset <= 1.0f
     //   offset +/- amplitude <= +/-1.0f
-    // To clip or not to clip?
+    // To clip or not to clip? quantizeSamples clips.
+
+    return amplitude * sine + offset;
+}
+
+// The argument of sin for square and sine waves
+constexpr double sineArgument(const int &sample, const int &samplingFrequency, const float &signalFrequency,
+                              const float &phase) {
+    return 2.0f*M_PI*signalFrequency*((float)sample / (float)samplingFrequency) + phase;
+}
+
+float computeSampleValueSquareWave(const int &sample, const int &samplingFrequency,
+                                   const float &amplitude, const float &signalFrequency,
+                                   const float &phase, const float &offset) {
+    return squareWaveValue(amplitude, std::sin(sineArgument(sample, samplingFrequency, signalFrequency, phase)) + offset);
+}
+
+constexpr float computeSampleValueSawtoothWave(const int &sample, const int &samplingFrequency,
+                                     const float &amplitude, const float &signalFrequency,
+                                     const float &phase, const float &offset) {
+    const float t = (float)sample / (float)samplingFrequency + phase;
+    const float period = 1.0 / signalFrequency;
+    
+    return sawtoothWaveValue(amplitude, t/period, offset);
+}
+
+float computeSampleValueSineWave(const int &sample, const int &samplingFrequency,
+                                 const float &amplitude, const float &signalFrequency,
+                                 const float &phase, const float &offset) {
+    return sineWaveValue(amplitude, std::sin(sineArgument(sample, samplingFrequency, signalFrequency, phase)), offset);
+}
+
+// NOTE: Rounding slowly pulls the rotation off the unit circle, so callers seek() every
+//       g_oscillatorSeekInterval samples.
+const int g_oscillatorSeekInterval = 1024;
+
+double turnsAtSample(const float &frequency, const int &sample, const int &samplingFrequency) {
+    return std::fmod((double)frequency * sample, (double)samplingFrequency) / samplingFrequency;
+}
+
+struct Oscillator {
+    Oscillator(const float &signalFrequency, const float &phase, const int &samplingFrequency) :
+        frequency(signalFrequency),
+        phase(phase),
+        samplingFrequency(samplingFrequency),
+        stepCosine(std::cos(2.0*M_PI*signalFrequency/samplingFrequency)),
+        stepSine(std::sin(2.0*M_PI*signalFrequency/samplingFrequency)),
+        cycleStep((double)signalFrequency/samplingFrequency),
+        cosine(),
+        sine(),
+        cycle()
+    {
+        seek(0);
+    }
+    
+    void seek(const int &sample) {
+        const double turns = turnsAtSample(frequency, sample, samplingFrequency);
+        const double angle = 2.0*M_PI*turns + phase;
+        cosine = std::cos(angle);
+        sine = std::sin(angle);
+        cycle = turns + (double)phase*frequency;
+        cycle -= std::floor(cycle);
+    }
+    
+    void advance() {
+        const double nextCosine = cosine*stepCosine - sine*stepSine;
+        sine = sine*stepCosine + cosine*stepSine;
+        cosine = nextCosine;
+        cycle += cycleStep;
+        if (cycle >= 1.0) {
+            cycle -= 1.0;
+        }
+    }
+    
+    float frequency;
+    float phase;
+    int samplingFrequency;
+    double stepCosine;
+    double stepSine;
+    double cycleStep;
+    double cosine;
+    double sine;
+    double cycle;
+};
+
+// NOTE: The SIMD kernels use a float polynomial sine within ~1e-7 of std::sin, below what survives quantization.
+typedef void (*BlockKernel)(const float &amplitude, const float &frequency, const float &phase,
+                            const float &offset, const int &blockStart, const int &blockLength,
+                            float *sums);
+
+enum class SimdLevel {
+    Scalar,
+    Sse41,
+    Avx2
+};
+
+SimdLevel g_simdLevel = SimdLevel::Scalar;
+
+template <Generator generator>
+float oscillatorSampleValue(const Oscillator &oscillator, const float &amplitude, const float &offset);
+
+template <>
+inline float oscillatorSampleValue<Generator::SquareWave>(const Oscillator &oscillator, const float &amplitude,
+                                                          const float &offset) {
+    return squareWaveValue(amplitude, oscillator.sine + offset);
+}
+
+template <>
+inline float oscillatorSampleValue<Generator::SawtoothWave>(const Oscillator &oscillator, const float &amplitude,
+                                                            const float &offset) {
+    return sawtoothWaveValue(amplitude, oscillator.cycle, offset);
+}
+
+template <>
+inline float oscillatorSampleValue<Generator::SineWave>(const Oscillator &oscillator, const float &amplitude,
+                                                        const float &offset) {
+    return sineWaveValue(amplitude, oscillator.sine, offset);
+}
+
+template <Generator generator>
+void oscillatorBlockScalar(const float &amplitude, const float &frequency, const float &phase,
+                           const float &offset, const int &blockStart, const int &blockLength,
+                           float *sums) {
+    Oscillator oscillator(frequency, phase, g_samplingFrequency);
+    oscillator.seek(blockStart);
+    for (int sample{}; sample < blockLength; ++sample) {
+        sums[sample] += oscillatorSampleValue<generator>(oscillator, amplitude, offset);
+        oscillator.advance();
+    }
+}
+
+// NOTE: Edges are found on 4*(f*n mod fs), an exact integer, so every SIMD level switches on the same samples.
+struct SquareWaveEdges {
+    SquareWaveEdges(const float &frequency, const float &phase, const float &offset, const int &blockStart) :
+        step(4.0 * frequency),
+        period(4.0 * g_samplingFrequency),
+        cyclesPerPosition(1.0 / period),
+        start(4.0 * std::fmod((double)frequency * blockStart, (double)g_samplingFrequency)),
+        peak(period * (0.25 - phase / (2.0 * M_PI))),
+        halfWidth(offset >= 1.0f ? period : offset < -1.0f ? -1.0 : period * (0.25 + std::asin(offset) / (2.0 * M_PI)))
+    {}
+    
+    // sample counts from blockStart
+    bool isHigh(const int &sample) const {
+        double distance = start + step * sample - peak;
+        // floor, without the libm call
+        const double cycles = distance * cyclesPerPosition + 0.5;
+        const double truncated = (double)(long long)cycles;
+        distance -= period * (truncated > cycles ? truncated - 1.0 : truncated);
+        return std::fabs(distance) <= halfWidth;
+    }
+    
+    double step;
+    double period;
+    double cyclesPerPosition;
+    double start;
+    double peak;
+    double halfWidth;
+};
+
+template <>
+void oscillatorBlockScalar<Generator::SquareWave>(const float &amplitude, const float &frequency, const float &phase,
+                                                  const float &offset, const int &blockStart, const int &blockLength,
+                                                  float *sums) {
+    const SquareWaveEdges edges(frequency, phase, offset, blockStart);
+    const float high = squareWaveValue(amplitude, 1.0f);
+    const float low = squareWaveValue(amplitude, -1.0f);
+    for (int sample{}; sample < blockLength; ++sample) {
+        sums[sample] += edges.isHigh(sample) ? high : low;
+    }
+}
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Fractional turns of samples first..first+3 of a block
+TARGET_SSE41 inline __m128 turnsSse41(const double &startTurns, const double &turnStep, const int &first) {
+    const __m128d step = _mm_set1_pd(turnStep);
+    const __m128d start = _mm_set1_pd(startTurns);
+    __m128d low = _mm_add_pd(start, _mm_mul_pd(_mm_set_pd(first + 1, first), step));
+    __m128d high = _mm_add_pd(start, _mm_mul_pd(_mm_set_pd(first + 3, first + 2), step));
+    low = _mm_sub_pd(low, _mm_floor_pd(low));
+    high = _mm_sub_pd(high, _mm_floor_pd(high));
+    return _mm_movelh_ps(_mm_cvtpd_ps(low), _mm_cvtpd_ps(high));
+}
+
+// sin(2*pi*turns): fold into sin(pi*y) with |y| <= 0.5, then Taylor up to y^11 (error < 6e-8)
+TARGET_SSE41 inline __m128 sinTurnsSse41(const __m128 &turns) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 y = _mm_sub_ps(turns, _mm_round_ps(turns, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    y = _mm_add_ps(y, y);
+    y = _mm_min_ps(y, _mm_sub_ps(one, y));
+    y = _mm_max_ps(y, _mm_sub_ps(_mm_set1_ps(-1.0f), y));
+    const __m128 x = _mm_mul_ps(y, _mm_set1_ps((float)M_PI));
+    const __m128 x2 = _mm_mul_ps(x, x);
+    __m128 poly = _mm_set1_ps(-1.0f/39916800.0f);
+    poly = _mm_add_ps(_mm_mul_ps(poly, x2), _mm_set1_ps(1.0f/362880.0f));
+    poly = _mm_add_ps(_mm_mul_ps(poly, x2), _mm_set1_ps(-1.0f/5040.0f));
+    poly = _mm_add_ps(_mm_mul_ps(poly, x2), _mm_set1_ps(1.0f/120.0f));
+    poly = _mm_add_ps(_mm_mul_ps(poly, x2), _mm_set1_ps(-1.0f/6.0f));
+    poly = _mm_add_ps(_mm_mul_ps(poly, x2), one);
+    return _mm_mul_ps(poly, x);
+}
+
+TARGET_SSE41 inline void addLanesSse41(const __m128 &values, const int &count, float *sums) {
+    if (count == 4) {
+        _mm_storeu_ps(sums, _mm_add_ps(_mm_loadu_ps(sums), values));
+        return;
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, values);
+    for (int lane{}; lane < count; ++lane) {
+        sums[lane] += lanes[lane];
+    }
+}
+
+// SquareWaveEdges::isHigh of two samples, all bits set where high
+TARGET_SSE41 inline __m128d squareHighSse41(const SquareWaveEdges &edges, const __m128d &samples) {
+    const __m128d period = _mm_set1_pd(edges.period);
+    __m128d distance = _mm_sub_pd(_mm_add_pd(_mm_set1_pd(edges.start), _mm_mul_pd(_mm_set1_pd(edges.step), samples)),
+                                  _mm_set1_pd(edges.peak));
+    const __m128d cycles = _mm_floor_pd(_mm_add_pd(_mm_mul_pd(distance, _mm_set1_pd(edges.cyclesPerPosition)),
+                                                   _mm_set1_pd(0.5)));
+    distance = _mm_sub_pd(distance, _mm_mul_pd(period, cycles));
+    distance = _mm_andnot_pd(_mm_set1_pd(-0.0), distance);
+    return _mm_cmple_pd(distance, _mm_set1_pd(edges.halfWidth));
+}
+
+TARGET_SSE41 void squareWaveBlockSse41(const float &amplitude, const float &frequency, const float &phase,
+                                       const float &offset, const int &blockStart, const int &blockLength,
+                                       float *sums) {
+    const SquareWaveEdges edges(frequency, phase, offset, blockStart);
+    const __m128 high = _mm_set1_ps(squareWaveValue(amplitude, 1.0f));
+    const __m128 low = _mm_set1_ps(squareWaveValue(amplitude, -1.0f));
+    for (int sample{}; sample < blockLength; sample += 4) {
+        const __m128d first = squareHighSse41(edges, _mm_set_pd(sample + 1, sample));
+        const __m128d second = squareHighSse41(edges, _mm_set_pd(sample + 3, sample + 2));
+        // the low 32 bits of each 64 bit mask, in sample order
+        const __m128 isHigh = _mm_shuffle_ps(_mm_castpd_ps(first), _mm_castpd_ps(second), _MM_SHUFFLE(2, 0, 2, 0));
+        addLanesSse41(_mm_blendv_ps(low, high, isHigh), std::min(4, blockLength - sample), sums + sample);
+    }
+}
+
+TARGET_SSE41 void sawtoothWaveBlockSse41(const float &amplitude, const float &frequency, const float &phase,
+                                         const float &offset, const int &blockStart, const int &blockLength,
+                                         float *sums) {
+    const double startTurns = turnsAtSample(frequency, blockStart, g_samplingFrequency) + (double)phase*frequency;
+    const double turnStep = (double)frequency / g_samplingFrequency;
+    // sawtoothWaveValue as rising * 2*amplitude + (2*offset/255 - 1), rising = centered + 0.5
+    const __m128 scale = _mm_set1_ps(2.0f * amplitude);
+    const __m128 shift = _mm_set1_ps(amplitude + 2.0f * offset / 255.0f - 1.0f);
+    for (int sample{}; sample < blockLength; sample += 4) {
+        const __m128 cycle = turnsSse41(startTurns, turnStep, sample);
+        const __m128 centered = _mm_sub_ps(cycle, _mm_floor_ps(_mm_add_ps(cycle, _mm_set1_ps(0.5f))));
+        addLanesSse41(_mm_add_ps(_mm_mul_ps(centered, scale), shift), std::min(4, blockLength - sample), sums + sample);
+    }
+}
+
+TARGET_SSE41 void sineWaveBlockSse41(const float &amplitude, const float &frequency, const float &phase,
+                                     const float &offset, const int &blockStart, const int &blockLength,
+                                     float *sums) {
+    const double startTurns = turnsAtSample(frequency, blockStart, g_samplingFrequency) + phase/(2.0*M_PI);
+    const double turnStep = (double)frequency / g_samplingFrequency;
+    const __m128 amplitudes = _mm_set1_ps(amplitude);
+    const __m128 offsets = _mm_set1_ps(offset);
+    for (int sample{}; sample < blockLength; sample += 4) {
+        const __m128 sine = sinTurnsSse41(turnsSse41(startTurns, turnStep, sample));
+        addLanesSse41(_mm_add_ps(_mm_mul_ps(amplitudes, sine), offsets), std::min(4, blockLength - sample), sums + sample);
+    }
+}
+
+// Fractional turns of samples first..first+7 of a block
+TARGET_AVX2 inline __m256 turnsAvx2(const double &startTurns, const double &turnStep, const int &first) {
+    const __m256d step = _mm256_set1_pd(turnStep);
+    const __m256d start = _mm256_set1_pd(startTurns);
+    __m256d low = _mm256_add_pd(start, _mm256_mul_pd(_mm256_set_pd(first + 3, first + 2, first + 1, first), step));
+    __m256d high = _mm256_add_pd(start, _mm256_mul_pd(_mm256_set_pd(first + 7, first + 6, first + 5, first + 4), step));
+    low = _mm256_sub_pd(low, _mm256_floor_pd(low));
+    high = _mm256_sub_pd(high, _mm256_floor_pd(high));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(low)), _mm256_cvtpd_ps(high), 1);
+}
+
+// Same polynomial as sinTurnsSse41
+TARGET_AVX2 inline __m256 sinTurnsAvx2(const __m256 &turns) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 y = _mm256_sub_ps(turns, _mm256_round_ps(turns, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    y = _mm256_add_ps(y, y);
+    y = _mm256_min_ps(y, _mm256_sub_ps(one, y));
+    y = _mm256_max_ps(y, _mm256_sub_ps(_mm256_set1_ps(-1.0f), y));
+    const __m256 x = _mm256_mul_ps(y, _mm256_set1_ps((float)M_PI));
+    const __m256 x2 = _mm256_mul_ps(x, x);
+    __m256 poly = _mm256_set1_ps(-1.0f/39916800.0f);
+    poly = _mm256_add_ps(_mm256_mul_ps(poly, x2), _mm256_set1_ps(1.0f/362880.0f));
+    poly = _mm256_add_ps(_mm256_mul_ps(poly, x2), _mm256_set1_ps(-1.0f/5040.0f));
+    poly = _mm256_add_ps(_mm256_mul_ps(poly, x2), _mm256_set1_ps(1.0f/120.0f));
+    poly = _mm256_add_ps(_mm256_mul_ps(poly, x2), _mm256_set1_ps(-1.0f/6.0f));
+    poly = _mm256_add_ps(_mm256_mul_ps(poly, x2), one);
+    return _mm256_mul_ps(poly, x);
+}
+
+TARGET_AVX2 inline void addLanesAvx2(const __m256 &values, const int &count, float *sums) {
+    if (count == 8) {
+        _mm256_storeu_ps(sums, _mm256_add_ps(_mm256_loadu_ps(sums), values));
+        return;
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, values);
+    for (int lane{}; lane < count; ++lane) {
+        sums[lane] += lanes[lane];
+    }
+}
+
+// Same as squareHighSse41, four samples
+TARGET_AVX2 inline __m256d squareHighAvx2(const SquareWaveEdges &edges, const __m256d &samples) {
+    const __m256d period = _mm256_set1_pd(edges.period);
+    __m256d distance = _mm256_sub_pd(_mm256_add_pd(_mm256_set1_pd(edges.start), _mm256_mul_pd(_mm256_set1_pd(edges.step), samples)),
+                                     _mm256_set1_pd(edges.peak));
+    const __m256d cycles = _mm256_floor_pd(_mm256_add_pd(_mm256_mul_pd(distance, _mm256_set1_pd(edges.cyclesPerPosition)),
+                                                         _mm256_set1_pd(0.5)));
+    distance = _mm256_sub_pd(distance, _mm256_mul_pd(period, cycles));
+    distance = _mm256_andnot_pd(_mm256_set1_pd(-0.0), distance);
+    return _mm256_cmp_pd(distance, _mm256_set1_pd(edges.halfWidth), _CMP_LE_OQ);
+}
+
+TARGET_AVX2 void squareWaveBlockAvx2(const float &amplitude, const float &frequency, const float &phase,
+                                     const float &offset, const int &blockStart, const int &blockLength,
+                                     float *sums) {
+    const SquareWaveEdges edges(frequency, phase, offset, blockStart);
+    const __m256 high = _mm256_set1_ps(squareWaveValue(amplitude, 1.0f));
+    const __m256 low = _mm256_set1_ps(squareWaveValue(amplitude, -1.0f));
+    for (int sample{}; sample < blockLength; sample += 8) {
+        const __m256d first = squareHighAvx2(edges, _mm256_set_pd(sample + 3, sample + 2, sample + 1, sample));
+        const __m256d second = squareHighAvx2(edges, _mm256_set_pd(sample + 7, sample + 6, sample + 5, sample + 4));
+        // the low 32 bits of each 64 bit mask, in sample order
+        const __m128 firstHalf = _mm_shuffle_ps(_mm_castpd_ps(_mm256_castpd256_pd128(first)),
+                                                _mm_castpd_ps(_mm256_extractf128_pd(first, 1)), _MM_SHUFFLE(2, 0, 2, 0));
+        const __m128 secondHalf = _mm_shuffle_ps(_mm_castpd_ps(_mm256_castpd256_pd128(second)),
+                                                 _mm_castpd_ps(_mm256_extractf128_pd(second, 1)), _MM_SHUFFLE(2, 0, 2, 0));
+        const __m256 isHigh = _mm256_insertf128_ps(_mm256_castps128_ps256(firstHalf), secondHalf, 1);
+        addLanesAvx2(_mm256_blendv_ps(low, high, isHigh), std::min(8, blockLength - sample), sums + sample);
+    }
+}
+
+TARGET_AVX2 void sawtoothWaveBlockAvx2(const float &amplitude, const float &frequency, const float &phase,
+                                       const float &offset, const int &blockStart, const int &blockLength,
+                                       float *sums) {
+    const double startTurns = turnsAtSample(frequency, blockStart, g_samplingFrequency) + (double)phase*frequency;
+    const double turnStep = (double)frequency / g_samplingFrequency;
+    const __m256 scale = _mm256_set1_ps(2.0f * amplitude);
+    const __m256 shift = _mm256_set1_ps(amplitude + 2.0f * offset / 255.0f - 1.0f);
+    for (int sample{}; sample < blockLength; sample += 8) {
+        const __m256 cycle = turnsAvx2(startTurns, turnStep, sample);
+        const __m256 centered = _mm256_sub_ps(cycle, _mm256_floor_ps(_mm256_add_ps(cycle, _mm256_set1_ps(0.5f))));
+        addLanesAvx2(_mm256_add_ps(_mm256_mul_ps(centered, scale), shift), std::min(8, blockLength - sample), sums + sample);
+    }
+}
+
+TARGET_AVX2 void sineWaveBlockAvx2(const float &amplitude, const float &frequency, const float &phase,
+                                   const float &offset, const int &blockStart, const int &blockLength,
+                                   float *sums) {
+    const double startTurns = turnsAtSample(frequency, blockStart, g_samplingFrequency) + phase/(2.0*M_PI);
+    const double turnStep = (double)frequency / g_samplingFrequency;
+    const __m256 amplitudes = _mm256_set1_ps(amplitude);
+    const __m256 offsets = _mm256_set1_ps(offset);
+    for (int sample{}; sample < blockLength; sample += 8) {
+        const __m256 sine = sinTurnsAvx2(turnsAvx2(startTurns, turnStep, sample));
+        addLanesAvx2(_mm256_add_ps(_mm256_mul_ps(amplitudes, sine), offsets), std::min(8, blockLength - sample), sums + sample);
+    }
+}
+#endif
+
+SimdLevel detectSimdLevel() {
+#if SIMD_X86
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    const bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+    bool avx2 = false;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = osAvx && (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    const bool sse41 = __builtin_cpu_supports("sse4.1");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2) {
+        return SimdLevel::Avx2;
+    }
+    if (sse41) {
+        return SimdLevel::Sse41;
+    }
+#endif
+    return SimdLevel::Scalar;
+}
+
+std::string simdLevelName(const SimdLevel &level) {
+    switch (level) {
+        case SimdLevel::Avx2:
+            return "avx2";
+        case SimdLevel::Sse41:
+            return "sse41";
+        default:
+            return "scalar";
+    }
+}
+
+template <Generator generator>
+BlockKernel selectBlockKernel(const SimdLevel &level) {
+    const bool isSquare = generator == Generator::SquareWave;
+    const bool isSawtooth = generator == Generator::SawtoothWave;
+#if SIMD_X86
+    if (level == SimdLevel::Avx2) {
+        return isSquare ? squareWaveBlockAvx2 : isSawtooth ? sawtoothWaveBlockAvx2 : sineWaveBlockAvx2;
+    }
+    if (level == SimdLevel::Sse41) {
+        return isSquare ? squareWaveBlockSse41 : isSawtooth ? sawtoothWaveBlockSse41 : sineWaveBlockSse41;
+    }
+#else
+    (void)level;
+    (void)isSquare;
+    (void)isSawtooth;
+#endif
+    return oscillatorBlockScalar<generator>;
+}
 
-    return (ALubyte) ((amplitude * std::sin(2.0f*M_PI*signalFrequency*t + phase) + offset + 1.0f) / 2.0f * 255.0f);
+template <Generator generator>
+float computeSampleValue(const int &sample, const int &samplingFrequency,
+                         const float &amplitude, const float &signalFrequency,
+                         const float &phase, const float &offset);
+
+template <>
+inline float computeSampleValue<Generator::SquareWave>(const int &sample, const int &samplingFrequency,
+                                                       const float &amplitude, const float &signalFrequency,
+                                                       const float &phase, const float &offset) {
+    return computeSampleValueSquareWave(sample, samplingFrequency, amplitude, signalFrequency, phase, offset);
+}
+
+template <>
+inline float computeSampleValue<Generator::SawtoothWave>(const int &sample, const int &samplingFrequency,
+                                                         const float &amplitude, const float &signalFrequency,
+                                                         const float &phase, const float &offset) {
+    return computeSampleValueSawtoothWave(sample, samplingFrequency, amplitude, signalFrequency, phase, offset);
+}
+
+template <>
+inline float computeSampleValue<Generator::SineWave>(const int &sample, const int &samplingFrequency,
+                                                     const float &amplitude, const float &signalFrequency,
+                                                     const float &phase, const float &offset) {
+    return computeSampleValueSineWave(sample, samplingFrequency, amplitude, signalFrequency, phase, offset);
+}
+
+// NOTE: Not used in any loop, here for clients that pick the generator at runtime.
+float computeSampleValue(const int &sample, const int &samplingFrequency, 
+                         const float &amplitude, const float &signalFrequency,
+                         const float &phase, const float offset, 
+                         const Generator &method=Generator::SquareWave) {
+    switch (method) {
+        case Generator::SquareWave:
+            return computeSampleValue<Generator::SquareWave>(sample, samplingFrequency, amplitude, signalFrequency, phase, offset);
+        case Generator::SawtoothWave:
+            return computeSampleValue<Generator::SawtoothWave>(sample, samplingFrequency, amplitude, signalFrequency, phase, offset);
+        default:
+            return computeSampleValue<Generator::SineWave>(sample, samplingFrequency, amplitude, signalFrequency, phase, offset);
+    }
+}
+
+int bytesPerSample(const SampleFormat &format) {
+    switch (format) {
+        case SampleFormat::Unsigned8:
+            return 1;
+        case SampleFormat::Signed16:
+            return 2;
+        default:
+            return 4;
+    }
 }
 
-ALubyte computeSampleValue(const int &sample, const int &samplingFrequency, 
-                           const float &amplitude, const float &signalFrequency,
-                           const float &phase, const float offset, 
-                           const std::string &method="squareWave") {
-    if (method == "squareWave") {
-        return computeSampleValueSquareWave(sample, samplingFrequency, amplitude, signalFrequency, phase, offset);
-    } else if (method == "sawtoothWave") {
-        return computeSampleValueSawtoothWave(sample, samplingFrequency, amplitude, signalFrequency, phase, offset);
+SampleFormat parseSampleFormat(const std::string &name) {
+    if (name == "u8") {
+        return SampleFormat::Unsigned8;
+    } else if (name == "f32") {
+        return SampleFormat::Float32;
     } else {
-        return computeSampleValueSineWave(sample, samplingFrequency, amplitude, signalFrequency, phase, offset);
+        return SampleFormat::Signed16;
+    }
+}
+
+// Clips to [-1, 1] and rounds to nearest, 8 bit output is unsigned with silence at 128.
+// std::lrint rounds like _mm256_cvtps_epi32, so both paths produce the same bytes.
+void quantizeSamplesScalar(const float *samples, const std::size_t &count, const SampleFormat &format,
+                           ALubyte *output) {
+    for (std::size_t i{}; i < count; ++i) {
+        const float clipped = std::min(std::max(samples[i], -1.0f), 1.0f);
+        if (format == SampleFormat::Unsigned8) {
+            output[i] = (ALubyte) std::lrint(clipped * 127.5f + 127.5f);
+        } else if (format == SampleFormat::Signed16) {
+            const std::int16_t value = (std::int16_t) std::lrint(clipped * 32767.0f);
+            std::memcpy(output + 2*i, &value, sizeof(value));
+        } else {
+            std::memcpy(output + 4*i, &clipped, sizeof(clipped));
+        }
+    }
+}
+
+#if SIMD_X86
+// 16 samples per iteration, the packs work per 128 bit lane so permute puts them back in order
+TARGET_AVX2 std::size_t quantizeSamplesAvx2(const float *samples, const std::size_t &count,
+                                            const SampleFormat &format, ALubyte *output) {
+    const __m256 minimum = _mm256_set1_ps(-1.0f);
+    const __m256 maximum = _mm256_set1_ps(1.0f);
+    const bool isUnsigned8 = format == SampleFormat::Unsigned8;
+    const __m256 scale = _mm256_set1_ps(isUnsigned8 ? 127.5f : 32767.0f);
+    const __m256 shift = _mm256_set1_ps(isUnsigned8 ? 127.5f : 0.0f);
+    std::size_t i{};
+    for (; i + 16 <= count; i += 16) {
+        const __m256 low = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(samples + i), minimum), maximum);
+        const __m256 high = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(samples + i + 8), minimum), maximum);
+        const __m256i lowInts = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_mul_ps(low, scale), shift));
+        const __m256i highInts = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_mul_ps(high, scale), shift));
+        const __m256i shorts = _mm256_permute4x64_epi64(_mm256_packs_epi32(lowInts, highInts), 0xD8);
+        if (isUnsigned8) {
+            const __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(shorts, shorts), 0xD8);
+            _mm_storeu_si128((__m128i*)(output + i), _mm256_castsi256_si128(bytes));
+        } else {
+            _mm256_storeu_si256((__m256i*)(output + 2*i), shorts);
+        }
+    }
+    return i;
+}
+#endif
+
+// output has room for count samples in format
+void quantizeSamples(const float *samples, const std::size_t &count, const SampleFormat &format, ALubyte *output) {
+    std::size_t done{};
+#if SIMD_X86
+    if (g_simdLevel == SimdLevel::Avx2 && format != SampleFormat::Float32) {
+        done = quantizeSamplesAvx2(samples, count, format, output);
+    }
+#endif
+    quantizeSamplesScalar(samples + done, count - done, format, output + done * bytesPerSample(format));
+}
+
+std::vector<ALubyte> quantizeSamples(const std::vector<float> &samples, const SampleFormat &format) {
+    std::vector<ALubyte> output(samples.size() * bytesPerSample(format));
+    quantizeSamples(samples.data(), samples.size(), format, output.data());
+    return output;
+}
+
+// Inverse of quantizeSamples, for the rare buffer that arrives in a different format
+std::vector<float> dequantizeSamples(const ALubyte *data, const std::size_t &count, const SampleFormat &format) {
+    std::vector<float> samples(count);
+    for (std::size_t i{}; i < count; ++i) {
+        if (format == SampleFormat::Unsigned8) {
+            samples[i] = (data[i] - 127.5f) / 127.5f;
+        } else if (format == SampleFormat::Signed16) {
+            std::int16_t value;
+            std::memcpy(&value, data + 2*i, sizeof(value));
+            samples[i] = value / 32767.0f;
+        } else {
+            std::memcpy(&samples[i], data + 4*i, sizeof(float));
+        }
+    }
+    return samples;
+}
+
+// Field for field the WAVEFORMATEX of samples/framework/Win32/CWaves.h, fixed width so it
+// lays out the same everywhere. Written as the 18 byte "fmt " chunk.
+#pragma pack(push, 1)
+struct WaveFormatEx {
+    std::uint16_t wFormatTag;
+    std::uint16_t nChannels;
+    std::uint32_t nSamplesPerSec;
+    std::uint32_t nAvgBytesPerSec;
+    std::uint16_t nBlockAlign;
+    std::uint16_t wBitsPerSample;
+    std::uint16_t cbSize;
+};
+#pragma pack(pop)
+
+// FNV-1a, 64 bit
+std::uint64_t hashBytes(const void *data, const std::size_t &size, std::uint64_t hash = 14695981039346656037ull) {
+    const std::uint8_t *bytes = (const std::uint8_t *)data;
+    for (std::size_t i{}; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// NOTE: writeStream may block until the sink has room, so a stream never runs far ahead of playback.
+struct AudioSink {
+    virtual ~AudioSink() {}
+    virtual void play(const ALubyte *buffer, const std::size_t &size, const int &milliseconds, const SampleFormat &format) = 0;
+    virtual void beginStream(const SampleFormat &format) = 0;
+    virtual void writeStream(const ALubyte *data, const std::size_t &size) = 0;
+    virtual void endStream() = 0;
+    // Part of a stream that may come again, like a note. key names what render() returns,
+    // so a sink can hold on to clips it has seen before.
+    virtual void writeClip(const std::uint64_t &/*key*/, const std::function<std::vector<ALubyte>()> &render) {
+        const std::vector<ALubyte> data = render();
+        writeStream(data.data(), data.size());
+    }
+    // after the last sound, prints what the sink did with it
+    virtual void finish() {}
+};
+
+AudioSink *g_sink = nullptr;
+
+void playBuffer(void* buffer, int bufferSize, int milliseconds, SampleFormat format = SampleFormat::Unsigned8) {
+    g_sink->play((const ALubyte *)buffer, bufferSize, milliseconds, format);
+}
+
+// Chunk size for playStream, and the OpenAL sink's ring of queued buffers, as in the OpenAL
+// SDK's PlayStream sample: 4 buffers of 250 ms, refilled every 20 ms.
+const int g_streamBufferCount = 4;
+const int g_streamBufferMilliseconds = 250;
+const int g_streamServiceMilliseconds = 20;
+
+// Plays audio as fill produces it. fill(data, capacity) writes up to capacity bytes and
+// returns how many it wrote, 0 ends the stream. Only one chunk is held here, and the sink
+// starts playing as soon as the first one arrives.
+template <typename Fill>
+void playStream(const SampleFormat &format, Fill fill) {
+    // whole samples only, a buffer must be a multiple of the block alignment
+    const int bufferSize = g_samplingFrequency * g_streamBufferMilliseconds / 1000 * bytesPerSample(format);
+    std::vector<ALubyte> data(bufferSize);
+    g_sink->beginStream(format);
+    for (int bytesWritten = fill(data.data(), bufferSize); bytesWritten > 0; bytesWritten = fill(data.data(), bufferSize)) {
+        g_sink->writeStream(data.data(), bytesWritten);
+    }
+    g_sink->endStream();
+}
+
+// Samples [firstSample, firstSample + count) of a note, counted from its start
+template <Generator generator>
+void renderNote(float *data, const int &firstSample, const int &count, const float &signalFrequency) {
+    for (int i = 0; i < count; ++i) {
+        data[i] = computeSampleValue<generator>(firstSample + i, g_samplingFrequency, 1.0f, signalFrequency, 0.0f, 0.0f);
+    }
+}
+
+void renderNote(float *data, const int &firstSample, const int &count, const float &signalFrequency) {
+    switch (g_generator) {
+        case Generator::SquareWave:
+            renderNote<Generator::SquareWave>(data, firstSample, count, signalFrequency);
+            break;
+        case Generator::SawtoothWave:
+            renderNote<Generator::SawtoothWave>(data, firstSample, count, signalFrequency);
+            break;
+        default:
+            renderNote<Generator::SineWave>(data, firstSample, count, signalFrequency);
+    }
+}
+
+// Adds amplitude times samples [firstSample, firstSample + count) of a note onto mix
+template <Generator generator>
+void mixNote(float *mix, const int &firstSample, const int &count, const float &signalFrequency, const float &amplitude) {
+    for (int i = 0; i < count; ++i) {
+        mix[i] += amplitude * computeSampleValue<generator>(firstSample + i, g_samplingFrequency, 1.0f, signalFrequency, 0.0f, 0.0f);
+    }
+}
+
+// One note of a timeline, times in samples
+struct NoteEvent {
+    int startSample;
+    int sampleCount;
+    float frequency;
+    float amplitude;
+    Generator generator;
+};
+
+void mixNote(float *mix, const int &firstSample, const int &count, const NoteEvent &note) {
+    switch (note.generator) {
+        case Generator::SquareWave:
+            mixNote<Generator::SquareWave>(mix, firstSample, count, note.frequency, note.amplitude);
+            break;
+        case Generator::SawtoothWave:
+            mixNote<Generator::SawtoothWave>(mix, firstSample, count, note.frequency, note.amplitude);
+            break;
+        default:
+            mixNote<Generator::SineWave>(mix, firstSample, count, note.frequency, note.amplitude);
+    }
+}
+
+// Where the last note of a timeline ends
+int timelineEnd(const std::vector<NoteEvent> &events) {
+    int endSample{};
+    for (const NoteEvent &event : events) {
+        endSample = std::max(endSample, event.startSample + event.sampleCount);
     }
+    return endSample;
 }
 
-void playBuffer(void* buffer, int bufferSize, int milliseconds) {
-    alSourcei(g_sources[0], AL_BUFFER, 0);
-    printAlError(alGetError(), "PlayNote_DetachBuffers");
+const int g_voiceCount = 128;
+
+// NOTE: With every voice busy, start() steals the one that started longest ago.
+struct VoicePool {
+    struct Voice {
+        NoteEvent note;
+        // samples of note played so far
+        int position;
+        bool isActive;
+        std::uint64_t startOrder;
+    };
     
-    alBufferData(g_buffers[0], 
-                    AL_FORMAT_MONO8, 
-                    buffer, 
-                    bufferSize,
-                    g_samplingFrequency);
-        
-    printAlError(alGetError(), "PlayNote_BufferData");
-        
-    alSourcei(g_sources[0], AL_BUFFER, g_buffers[0]);
-    printAlError(alGetError(), "PlayNote_BindBuffer");
-        
-    alSourcePlay(g_sources[0]);
-        
-    std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
-    alSourceStop(g_sources[0]);
-    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    VoicePool() : voices(), startCount(0), stolenCount(0), activeCount(0), peakActiveCount(0) {}
+    
+    void start(const NoteEvent &note) {
+        Voice *target = &voices[0];
+        for (auto &voice : voices) {
+            if (!voice.isActive) {
+                target = &voice;
+                break;
+            }
+            if (voice.startOrder < target->startOrder) {
+                target = &voice;
+            }
+        }
+        if (target->isActive) {
+            ++stolenCount;
+        } else {
+            ++activeCount;
+            peakActiveCount = std::max(peakActiveCount, activeCount);
+        }
+        *target = Voice{note, 0, true, startCount++};
+    }
+    
+    // Adds the next count samples of every active voice onto mix, returns how many samples
+    // the longest of them had left, up to count
+    int render(float *mix, const int &count) {
+        int played{};
+        for (auto &voice : voices) {
+            if (!voice.isActive) {
+                continue;
+            }
+            const NoteEvent &note = voice.note;
+            const int length = std::min(count, note.sampleCount - voice.position);
+            mixNote(mix, voice.position, length, note);
+            voice.position += length;
+            played = std::max(played, length);
+            if (voice.position == note.sampleCount) {
+                voice.isActive = false;
+                --activeCount;
+            }
+        }
+        return played;
+    }
+    
+    std::array<Voice, g_voiceCount> voices;
+    std::uint64_t startCount;
+    int stolenCount;
+    int activeCount;
+    int peakActiveCount;
+};
+
+// Plays a timeline sorted by start, block by block. Every note starts on its exact sample,
+// a block is split wherever one starts.
+struct TimelineRenderer {
+    explicit TimelineRenderer(const std::vector<NoteEvent> &events) : events(events), nextEvent(0), sample(0) {}
+    
+    // Up to count samples, fewer only at the end of the timeline
+    int render(float *samples, const int &count) {
+        std::fill(samples, samples + count, 0.0f);
+        int rendered{};
+        while (rendered < count) {
+            while (nextEvent < events.size() && events[nextEvent].startSample <= sample) {
+                voices.start(events[nextEvent++]);
+            }
+            if (voices.activeCount == 0 && nextEvent == events.size()) {
+                break;
+            }
+            int length = count - rendered;
+            if (nextEvent < events.size()) {
+                length = std::min(length, events[nextEvent].startSample - sample);
+            }
+            const int played = voices.render(samples + rendered, length);
+            if (nextEvent == events.size() && played < length) {
+                // the timeline ends with the last voice
+                rendered += played;
+                sample += played;
+                break;
+            }
+            rendered += length;
+            sample += length;
+        }
+        return rendered;
+    }
+    
+    const std::vector<NoteEvent> &events;
+    std::size_t nextEvent;
+    int sample;
+    VoicePool voices;
+};
+
+void playTimeline(const std::vector<NoteEvent> &events) {
+    TimelineRenderer renderer(events);
+    const int sampleSize = bytesPerSample(g_sampleFormat);
+    std::vector<float> samples(g_samplingFrequency * g_streamBufferMilliseconds / 1000);
+    playStream(g_sampleFormat, [&](ALubyte *data, const int &capacity) {
+        const int count = renderer.render(samples.data(), std::min((int)samples.size(), capacity / sampleSize));
+        quantizeSamples(samples.data(), count, g_sampleFormat, data);
+        return count * sampleSize;
+    });
+    if (renderer.voices.stolenCount > 0) {
+        std::cout << "voices stolen: " << renderer.voices.stolenCount << std::endl;
+    }
 }
 
-void playNote(const float &frequency, const int &durationDivisor) {
-    std::array<ALubyte, g_samplingFrequency> data;
-    auto signalFrequency = frequency;
-    for (int sample = 0; sample < g_samplingFrequency; ++sample) {
-        data[sample] = computeSampleValue(sample, g_samplingFrequency, 1.0f, signalFrequency, 0.0f, 0.0f, g_generator);
+// Cuts notes off the way VoicePool steals them: a note starting while g_voiceCount others
+// still sound takes the place of the one that started longest ago. events are sorted by
+// start, returns how many notes were cut.
+int limitPolyphony(std::vector<NoteEvent> &events) {
+    int stolenCount{};
+    // indices of the notes sounding, oldest start first
+    std::vector<std::size_t> sounding;
+    for (std::size_t i{}; i < events.size(); ++i) {
+        const int start = events[i].startSample;
+        sounding.erase(std::remove_if(sounding.begin(), sounding.end(), [&](const std::size_t &index) {
+            return events[index].startSample + events[index].sampleCount <= start;
+        }), sounding.end());
+        if ((int)sounding.size() == g_voiceCount) {
+            NoteEvent &stolen = events[sounding.front()];
+            stolen.sampleCount = start - stolen.startSample;
+            sounding.erase(sounding.begin());
+            ++stolenCount;
+        }
+        sounding.push_back(i);
     }
+    return stolenCount;
+}
+
+void playNote(const float &frequency, const int &durationDivisor) {
+    std::vector<float> data(g_samplingFrequency);
+    renderNote(data.data(), 0, g_samplingFrequency, frequency);
     
-    playBuffer((void*)data.data(), g_samplingFrequency, 1000/durationDivisor);
+    const std::vector<ALubyte> pcmData = quantizeSamples(data, g_sampleFormat);
+    playBuffer((void*)pcmData.data(), pcmData.size(), 1000/durationDivisor, g_sampleFormat);
+}
+
+// NOTE: Equal temperament with A4 = MIDI note 69 = 440 Hz, computed by the compiler.
+constexpr double g_semitoneRatio = 1.0594630943592952646;
+
+constexpr double midiPitch(int note) {
+    return note > 69 ? midiPitch(note - 1) * g_semitoneRatio
+         : note < 69 ? midiPitch(note + 1) / g_semitoneRatio
+         : 440.0;
 }
 
+#define MIDI_PITCHES_4(n) (float)midiPitch(n), (float)midiPitch(n + 1), (float)midiPitch(n + 2), (float)midiPitch(n + 3)
+#define MIDI_PITCHES_16(n) MIDI_PITCHES_4(n), MIDI_PITCHES_4(n + 4), MIDI_PITCHES_4(n + 8), MIDI_PITCHES_4(n + 12)
+constexpr float g_midiPitches[128] = {
+    MIDI_PITCHES_16(0), MIDI_PITCHES_16(16), MIDI_PITCHES_16(32), MIDI_PITCHES_16(48),
+    MIDI_PITCHES_16(64), MIDI_PITCHES_16(80), MIDI_PITCHES_16(96), MIDI_PITCHES_16(112)
+};
+#undef MIDI_PITCHES_16
+#undef MIDI_PITCHES_4
+static_assert(g_midiPitches[69] == 440.0f, "A4 is 440 Hz");
+static_assert(g_midiPitches[57] > 219.999f && g_midiPitches[57] < 220.001f, "A3 is 220 Hz");
+static_assert(g_midiPitches[60] > 261.625f && g_midiPitches[60] < 261.626f, "middle C is 261.626 Hz");
+
+// isChordTone notes start together with the note before them, rests only take up time
 struct Note {
-    Note(const char &name, const int &durationDivisor) : 
+    Note(const char &name, const int &durationDivisor, const bool &isChordTone = false) : 
         name(name),
         durationDivisor(durationDivisor),
-        frequency() 
+        isChordTone(isChordTone),
+        isRest(false),
+        frequency(),
+        generator(g_generator)
     {
+        // the octave from middle C
         switch (name) {
             case 'c':
-                frequency = 261.626f;
+                frequency = g_midiPitches[60];
                 break;
             case 'd':
-                frequency = 293.665f;
+                frequency = g_midiPitches[62];
                 break;
             case 'e':
-                frequency = 329.628f;
+                frequency = g_midiPitches[64];
                 break;
             case 'f':
-                frequency = 349.228f;
+                frequency = g_midiPitches[65];
                 break;
             case 'g':
-                frequency = 391.995f;
+                frequency = g_midiPitches[67];
                 break;
             case 'a':
-                frequency = 440.000f;
+                frequency = g_midiPitches[69];
+                break;
+            case 'b':
+                frequency = g_midiPitches[71];
                 break;
             default:
-                // TODO(mja): throw
-                frequency = 440.000f;
+                std::cout << "Unknown note " << name << ", playing a" << std::endl;
+                frequency = g_midiPitches[69];
         }
     }
+    
+    // Any MIDI key, a negative key is a rest
+    Note(const int &midiKey, const int &durationDivisor, const bool &isChordTone, const Generator &generator) :
+        name(midiKey < 0 ? 'r' : "ccddeffggaab"[midiKey % 12]),
+        durationDivisor(durationDivisor),
+        isChordTone(isChordTone),
+        isRest(midiKey < 0),
+        frequency(midiKey < 0 ? 0.0f : g_midiPitches[midiKey]),
+        generator(generator)
+    {}
 
     char name;
     int durationDivisor;
+    bool isChordTone;
+    bool isRest;
     float frequency;
+    Generator generator;
 };
 
 // TODO(mja): Why is alBufferdata sometimes generating AL_INVALID_OPERATION after 
@@ -211,61 +1111,2921 @@ void playNote(char noteName, int durationDivisor) {
     playNote(note.frequency, note.durationDivisor);
 }
 
-void playNotes(const std::vector<Note> &notes) {
-    for (auto &note : notes) {
-        playNote(note.frequency, note.durationDivisor);
+// Everything that goes into a note's samples
+std::uint64_t noteKey(const float &frequency, const int &sampleCount) {
+    const int settings[] = { sampleCount, (int)g_generator, (int)g_sampleFormat, g_samplingFrequency };
+    return hashBytes(settings, sizeof(settings), hashBytes(&frequency, sizeof(frequency)));
+}
+
+// The next note after a chord starts when the chord's first note ends, longer chord tones
+// ring on under it. A chord's tones share one note's loudness, so a chord can't clip where
+// a single note doesn't.
+std::vector<NoteEvent> noteTimeline(const std::vector<Note> &notes) {
+    std::vector<NoteEvent> events;
+    events.reserve(notes.size());
+    int chordStart{};
+    int nextStart{};
+    int chordSize = 1;
+    for (std::size_t i{}; i < notes.size(); ++i) {
+        const int noteLength = g_samplingFrequency / notes[i].durationDivisor;
+        if (i == 0 || !notes[i].isChordTone) {
+            chordStart = nextStart;
+            nextStart = chordStart + noteLength;
+            chordSize = 1;
+            while (i + chordSize < notes.size() && notes[i + chordSize].isChordTone) {
+                ++chordSize;
+            }
+        }
+        if (!notes[i].isRest) {
+            events.push_back(NoteEvent{chordStart, noteLength, notes[i].frequency, 1.0f / chordSize, notes[i].generator});
+        }
     }
+    return events;
 }
 
-void setupOpenAlDeviceWithOneSourceAndOneBuffer() {
-    alcGetError(g_device);
+// NOTE: Timing comes from the device consuming queued buffers, not sleep_for, so no drift adds up.
+void playNotes(const std::vector<Note> &notes) {
+    const bool needsTimeline = std::any_of(notes.begin(), notes.end(), [](const Note &note) {
+        return note.isChordTone || note.isRest || note.generator != g_generator;
+    });
+    if (needsTimeline) {
+        playTimeline(noteTimeline(notes));
+        return;
+    }
+    
+    g_sink->beginStream(g_sampleFormat);
+    for (const Note &note : notes) {
+        const int noteLength = g_samplingFrequency / note.durationDivisor;
+        g_sink->writeClip(noteKey(note.frequency, noteLength), [&]() {
+            std::vector<float> samples(noteLength);
+            renderNote(samples.data(), 0, noteLength, note.frequency);
+            return quantizeSamples(samples, g_sampleFormat);
+        });
+    }
+    g_sink->endStream();
+}
+
+// g_sources[0] loops for play(), g_sources[1] plays streams from its queue
+void setupOpenAlDevice() {
+    alcGetError(g_device);
+    
+    g_device = alcOpenDevice(0);
+    g_context = alcCreateContext(g_device, 0);
+    alcMakeContextCurrent(g_context);
+    printAlcError(alcGetError(g_device), "alcOpenDevice");
+
+    alGenBuffers(2, g_buffers);
+    printAlError(alGetError());
+    
+    alGenSources(2, g_sources);
+    printAlError(alGetError());
+    
+    alSourcei(g_sources[0], AL_LOOPING, AL_TRUE);
+    printAlError(alGetError());
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+}
+
+void tearDownOpenAl() {
+    printAlcError(alcGetError(g_device), "alcCloseDevice_pre");
+    
+    ALCboolean closeSucceeded = alcCloseDevice(g_device);
+    if (!closeSucceeded) {
+        std::cout << "closing device failed";
+    }
+}
+
+// NOTE: Buffers still queued on a source are never evicted, even past g_alBufferByteLimit.
+struct AlBufferPool {
+    struct Entry {
+        ALuint buffer;
+        std::size_t size;
+        std::uint64_t lastUse;
+        int queuedCount;
+    };
+    
+    AlBufferPool() : byteCount(0), useCount(0), uploadCount(0), reuseCount(0) {}
+    
+    void addSpareBuffers(const ALuint *buffers, const int &count) {
+        spareBuffers.insert(spareBuffers.end(), buffers, buffers + count);
+    }
+    
+    // The entry holding key's clip. On a miss upload(buffer) fills a buffer with
+    // alBufferData and returns its size in bytes.
+    template <typename Upload>
+    const Entry &acquire(const std::uint64_t &key, Upload upload) {
+        ++useCount;
+        auto entry = entries.find(key);
+        if (entry != entries.end()) {
+            ++reuseCount;
+            entry->second.lastUse = useCount;
+            return entry->second;
+        }
+        ALuint buffer{};
+        if (spareBuffers.empty()) {
+            alGenBuffers(1, &buffer);
+            printAlError(alGetError(), "BufferPool_GenBuffers");
+        } else {
+            buffer = spareBuffers.back();
+            spareBuffers.pop_back();
+        }
+        const std::size_t size = upload(buffer);
+        ++uploadCount;
+        byteCount += size;
+        entry = entries.insert(std::make_pair(key, Entry{buffer, size, useCount, 0})).first;
+        evict(key);
+        return entry->second;
+    }
+    
+    // A queued buffer can't be deleted until the source is done with it
+    void pin(const std::uint64_t &key) {
+        ++entries[key].queuedCount;
+    }
+    
+    void unpin(const std::uint64_t &key) {
+        --entries[key].queuedCount;
+    }
+    
+    void clear() {
+        for (const auto &entry : entries) {
+            alDeleteBuffers(1, &entry.second.buffer);
+        }
+        alDeleteBuffers((ALsizei)spareBuffers.size(), spareBuffers.data());
+        printAlError(alGetError(), "BufferPool_DeleteBuffers");
+        entries.clear();
+        spareBuffers.clear();
+        byteCount = 0;
+    }
+    
+    std::uint64_t byteCount;
+    std::uint64_t useCount;
+    int uploadCount;
+    int reuseCount;
+    
+private:
+    // Least recently used first, never keep
+    void evict(const std::uint64_t &keep) {
+        while (byteCount > g_alBufferByteLimit) {
+            auto oldest = entries.end();
+            for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+                if (entry->first != keep && entry->second.queuedCount == 0
+                    && (oldest == entries.end() || entry->second.lastUse < oldest->second.lastUse)) {
+                    oldest = entry;
+                }
+            }
+            if (oldest == entries.end()) {
+                return;
+            }
+            alDeleteBuffers(1, &oldest->second.buffer);
+            byteCount -= oldest->second.size;
+            entries.erase(oldest);
+        }
+    }
+    
+    std::map<std::uint64_t, Entry> entries;
+    std::vector<ALuint> spareBuffers;
+};
+
+// The sound card. play() binds pooled buffers to the looping g_sources[0], streams are
+// queued on g_sources[1]: chunks in a ring of g_streamBufferCount buffers of their own,
+// clips as pooled buffers.
+struct OpenAlSink : AudioSink {
+    OpenAlSink() : streamFormat(SampleFormat::Unsigned8), queuedSamples(0), hasStarted(false), underrunCount(0) {
+        setupOpenAlDevice();
+        pool.addSpareBuffers(g_buffers, 2);
+    }
+    
+    ~OpenAlSink() override {
+        pool.clear();
+        tearDownOpenAl();
+    }
+    
+    void play(const ALubyte *buffer, const std::size_t &size, const int &milliseconds, const SampleFormat &format) override {
+        const std::uint64_t key = hashBytes(&format, sizeof(format), hashBytes(buffer, size));
+        const AlBufferPool::Entry &entry = pool.acquire(key, [&](const ALuint &target) {
+            alBufferData(target, alFormat(format), buffer, (ALsizei)size, g_samplingFrequency);
+            printAlError(alGetError(), "PlayNote_BufferData");
+            return size;
+        });
+            
+        alSourcei(g_sources[0], AL_BUFFER, entry.buffer);
+        printAlError(alGetError(), "PlayNote_BindBuffer");
+            
+        alSourcePlay(g_sources[0]);
+            
+        std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+        alSourceStop(g_sources[0]);
+        // detached, so the pool may delete the buffer
+        alSourcei(g_sources[0], AL_BUFFER, 0);
+        printAlError(alGetError(), "PlayNote_DetachBuffers");
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    
+    void beginStream(const SampleFormat &format) override {
+        streamFormat = format;
+        hasStarted = false;
+        underrunCount = 0;
+        freeBuffers.resize(g_streamBufferCount);
+        alGenBuffers(g_streamBufferCount, freeBuffers.data());
+        printAlError(alGetError(), "PlayStream_GenBuffers");
+    }
+    
+    void writeStream(const ALubyte *data, const std::size_t &size) override {
+        reclaimProcessedBuffers();
+        while (freeBuffers.empty()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(g_streamServiceMilliseconds));
+            reclaimProcessedBuffers();
+        }
+        const ALuint buffer = freeBuffers.back();
+        freeBuffers.pop_back();
+        alBufferData(buffer, alFormat(streamFormat), data, (ALsizei)size, g_samplingFrequency);
+        queueBuffer(QueuedBuffer{buffer, (int)(size / bytesPerSample(streamFormat)), false, 0});
+    }
+    
+    // Clips wait until less than the chunk ring's worth of audio is queued ahead of them
+    void writeClip(const std::uint64_t &key, const std::function<std::vector<ALubyte>()> &render) override {
+        const int queueLimit = g_streamBufferCount * g_samplingFrequency * g_streamBufferMilliseconds / 1000;
+        reclaimProcessedBuffers();
+        while (queuedSamples >= queueLimit) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(g_streamServiceMilliseconds));
+            reclaimProcessedBuffers();
+        }
+        const AlBufferPool::Entry &entry = pool.acquire(key, [&](const ALuint &target) {
+            const std::vector<ALubyte> data = render();
+            alBufferData(target, alFormat(streamFormat), data.data(), (ALsizei)data.size(), g_samplingFrequency);
+            return data.size();
+        });
+        pool.pin(key);
+        queueBuffer(QueuedBuffer{entry.buffer, (int)(entry.size / bytesPerSample(streamFormat)), true, key});
+    }
+    
+    void endStream() override {
+        for (;;) {
+            ALint queuedCount{};
+            ALint processedCount{};
+            alGetSourcei(g_sources[1], AL_BUFFERS_QUEUED, &queuedCount);
+            alGetSourcei(g_sources[1], AL_BUFFERS_PROCESSED, &processedCount);
+            if (processedCount >= queuedCount) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(g_streamServiceMilliseconds));
+        }
+        reclaimProcessedBuffers();
+        alSourceStop(g_sources[1]);
+        alDeleteBuffers((ALsizei)freeBuffers.size(), freeBuffers.data());
+        freeBuffers.clear();
+        printAlError(alGetError(), "PlayStream_Cleanup");
+        if (underrunCount > 0) {
+            std::cout << "stream underruns: " << underrunCount << std::endl;
+        }
+    }
+    
+    void finish() override {
+        std::cout << "AL buffer pool: " << pool.uploadCount << " uploads, " << pool.reuseCount << " reused, "
+                  << pool.byteCount << " bytes held" << std::endl;
+    }
+    
+private:
+    // AL_FORMAT_MONO_FLOAT32 is from AL_EXT_float32 and not in our al.h, main checks the extension
+    static ALenum alFormat(const SampleFormat &format) {
+        switch (format) {
+            case SampleFormat::Unsigned8:
+                return AL_FORMAT_MONO8;
+            case SampleFormat::Signed16:
+                return AL_FORMAT_MONO16;
+            default:
+                return alGetEnumValue("AL_FORMAT_MONO_FLOAT32");
+        }
+    }
+    
+    struct QueuedBuffer {
+        ALuint buffer;
+        int sampleCount;
+        bool isPooled;
+        std::uint64_t key;
+    };
+    
+    void queueBuffer(const QueuedBuffer &queuedBuffer) {
+        alSourceQueueBuffers(g_sources[1], 1, &queuedBuffer.buffer);
+        printAlError(alGetError(), "PlayStream_QueueBuffer");
+        queued.push_back(queuedBuffer);
+        queuedSamples += queuedBuffer.sampleCount;
+        
+        // A source that stopped after it started ran dry before we refilled, restart it.
+        // Its processed buffers are unqueued by now, so it picks up with the new one.
+        ALint state{};
+        alGetSourcei(g_sources[1], AL_SOURCE_STATE, &state);
+        if (state != AL_PLAYING) {
+            underrunCount += hasStarted ? 1 : 0;
+            hasStarted = true;
+            alSourcePlay(g_sources[1]);
+        }
+    }
+    
+    // Buffers come off the queue in the order they went on
+    void reclaimProcessedBuffers() {
+        ALint processedCount{};
+        alGetSourcei(g_sources[1], AL_BUFFERS_PROCESSED, &processedCount);
+        for (; processedCount > 0 && !queued.empty(); --processedCount) {
+            ALuint buffer{};
+            alSourceUnqueueBuffers(g_sources[1], 1, &buffer);
+            const QueuedBuffer processed = queued.front();
+            queued.pop_front();
+            queuedSamples -= processed.sampleCount;
+            if (processed.isPooled) {
+                pool.unpin(processed.key);
+            } else {
+                freeBuffers.push_back(buffer);
+            }
+        }
+    }
+    
+    AlBufferPool pool;
+    SampleFormat streamFormat;
+    std::vector<ALuint> freeBuffers;
+    std::deque<QueuedBuffer> queued;
+    int queuedSamples;
+    bool hasStarted;
+    int underrunCount;
+};
+
+// Sinks without a device. They take sound as fast as it comes, in one sample format:
+// play() becomes what the looping source would have played for that long plus the 5 ms
+// pause after every stop, streams are appended back to back.
+struct OfflineSink : AudioSink {
+    explicit OfflineSink(const SampleFormat &format) : format(format), byteCount(0), streamFormat(SampleFormat::Unsigned8) {}
+    
+    void play(const ALubyte *buffer, const std::size_t &size, const int &milliseconds, const SampleFormat &format) override {
+        const std::size_t blockAlign = bytesPerSample(format);
+        std::size_t remaining = (std::size_t)g_samplingFrequency * milliseconds / 1000 * blockAlign;
+        while (remaining > 0 && size > 0) {
+            const std::size_t count = std::min(remaining, size);
+            appendConverted(buffer, count, format);
+            remaining -= count;
+        }
+        const std::vector<float> silence(g_samplingFrequency * 5 / 1000, 0.0f);
+        const std::vector<ALubyte> data = quantizeSamples(silence, this->format);
+        appendConverted(data.data(), data.size(), this->format);
+    }
+    
+    void beginStream(const SampleFormat &format) override {
+        streamFormat = format;
+    }
+    
+    void writeStream(const ALubyte *data, const std::size_t &size) override {
+        appendConverted(data, size, streamFormat);
+    }
+    
+    void endStream() override {}
+    
+    std::uint64_t sampleCount() const {
+        return byteCount / bytesPerSample(format);
+    }
+    
+    const SampleFormat format;
+    
+protected:
+    // data is in format
+    virtual void append(const ALubyte *data, const std::size_t &size) = 0;
+    
+private:
+    void appendConverted(const ALubyte *data, const std::size_t &size, const SampleFormat &bufferFormat) {
+        if (bufferFormat == format) {
+            byteCount += size;
+            append(data, size);
+            return;
+        }
+        const std::size_t count = size / bytesPerSample(bufferFormat);
+        const std::vector<ALubyte> converted = quantizeSamples(dequantizeSamples(data, count, bufferFormat), format);
+        byteCount += converted.size();
+        append(converted.data(), converted.size());
+    }
+    
+    std::uint64_t byteCount;
+    SampleFormat streamFormat;
+};
+
+// Discards everything, for timing synthesis on its own
+struct NullSink : OfflineSink {
+    explicit NullSink(const SampleFormat &format) : OfflineSink(format) {}
+    
+    void finish() override {
+        std::cout << "Discarded " << sampleCount() << " samples" << std::endl;
+    }
+    
+protected:
+    void append(const ALubyte *, const std::size_t &) override {}
+};
+
+// Keeps everything in data
+struct MemorySink : OfflineSink {
+    explicit MemorySink(const SampleFormat &format) : OfflineSink(format) {}
+    
+    void finish() override;
+    
+    std::vector<ALubyte> data;
+    
+protected:
+    void append(const ALubyte *bytes, const std::size_t &size) override {
+        data.insert(data.end(), bytes, bytes + size);
+    }
+};
+
+// NOTE: A background thread does the file writes, close() patches in the RIFF and data sizes.
+struct FileSink : OfflineSink {
+    FileSink(const std::string &fileName, const SampleFormat &format)
+    : OfflineSink(format), fileName(fileName), file(fileName, std::ios::binary), isWave(false), isClosing(false) {
+        isWave = fileName.size() >= 4 && fileName.compare(fileName.size() - 4, 4, ".wav") == 0;
+        if (isWave) {
+            const std::uint16_t WAVE_FORMAT_PCM = 1;
+            const std::uint16_t WAVE_FORMAT_IEEE_FLOAT = 3;
+            WaveFormatEx waveFormat{};
+            waveFormat.wFormatTag = format == SampleFormat::Float32 ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+            waveFormat.nChannels = 1;
+            waveFormat.nSamplesPerSec = g_samplingFrequency;
+            waveFormat.nBlockAlign = (std::uint16_t)bytesPerSample(format);
+            waveFormat.nAvgBytesPerSec = g_samplingFrequency * waveFormat.nBlockAlign;
+            waveFormat.wBitsPerSample = (std::uint16_t)(8 * waveFormat.nBlockAlign);
+            const std::uint32_t formatSize = sizeof(waveFormat);
+            const std::uint32_t placeholder = 0;
+            file.write("RIFF", 4);
+            file.write((const char *)&placeholder, 4);
+            file.write("WAVEfmt ", 8);
+            file.write((const char *)&formatSize, 4);
+            file.write((const char *)&waveFormat, sizeof(waveFormat));
+            file.write("data", 4);
+            file.write((const char *)&placeholder, 4);
+        }
+        writer = std::thread([this]() { writeQueued(); });
+    }
+    
+    ~FileSink() override {
+        close();
+    }
+    
+    bool isOpen() const {
+        return file.is_open();
+    }
+    
+    // false if any write failed
+    bool close() {
+        if (!writer.joinable()) {
+            return !file.fail();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isClosing = true;
+            wakeUp.notify_one();
+        }
+        writer.join();
+        if (isWave) {
+            // "RIFF" size "WAVE" "fmt " size format "data" size, then the samples
+            const std::uint32_t headerSize = 4 + 4 + 4 + 4 + 4 + sizeof(WaveFormatEx) + 4 + 4;
+            const std::uint32_t dataSize = (std::uint32_t)writtenCount;
+            const std::uint32_t padding = dataSize % 2; // chunks are word aligned
+            if (padding) {
+                file.put(0);
+            }
+            const std::uint32_t riffSize = headerSize - 8 + dataSize + padding;
+            file.seekp(4);
+            file.write((const char *)&riffSize, 4);
+            file.seekp(headerSize - 4);
+            file.write((const char *)&dataSize, 4);
+        }
+        file.close();
+        return !file.fail();
+    }
+    
+    void finish() override {
+        close();
+        std::cout << "Rendered " << sampleCount() << " samples to " << fileName << std::endl;
+    }
+    
+protected:
+    void append(const ALubyte *data, const std::size_t &size) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        chunks.emplace_back(data, data + size);
+        wakeUp.notify_one();
+    }
+    
+private:
+    void writeQueued() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wakeUp.wait(lock, [this]() { return !chunks.empty() || isClosing; });
+            if (chunks.empty()) {
+                return;
+            }
+            std::vector<ALubyte> chunk = std::move(chunks.front());
+            chunks.pop_front();
+            lock.unlock();
+            file.write((const char *)chunk.data(), chunk.size());
+            writtenCount += chunk.size();
+            lock.lock();
+        }
+    }
+    
+    std::string fileName;
+    std::ofstream file;
+    bool isWave;
+    std::uint64_t writtenCount = 0;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::deque<std::vector<ALubyte>> chunks;
+    bool isClosing;
+};
+
+// NOTE: Built-in songs are constexpr note lists. Building with -DBAKE_BUILTIN_SONGS also bakes
+//       their s16 samples, which needs -fconstexpr-steps=16777216 (clang) or /constexpr:steps16777216 (cl).
+
+// Reduced to [-pi/2, pi/2], where 12 Taylor terms are exact to double precision
+constexpr double constexprSin(double x) {
+    const double turns = x / (2.0 * M_PI);
+    x -= 2.0 * M_PI * (double)(long long)(turns < 0.0 ? turns - 0.5 : turns + 0.5);
+    // sin(pi - x) = sin(x)
+    if (x > M_PI / 2) {
+        x = M_PI - x;
+    } else if (x < -M_PI / 2) {
+        x = -M_PI - x;
+    }
+    // Horner form of x - x^3/3! + x^5/5! - ... - x^23/23!
+    const double x2 = x * x;
+    return x * (1.0 - x2 / (2 * 3) * (1.0 - x2 / (4 * 5) * (1.0 - x2 / (6 * 7) * (1.0 - x2 / (8 * 9)
+             * (1.0 - x2 / (10 * 11) * (1.0 - x2 / (12 * 13) * (1.0 - x2 / (14 * 15) * (1.0 - x2 / (16 * 17)
+             * (1.0 - x2 / (18 * 19) * (1.0 - x2 / (20 * 21) * (1.0 - x2 / (22 * 23))))))))))));
+}
+
+// std::lrint in the default round to nearest even mode
+constexpr long constexprLrint(const float &value) {
+    const float lower = constexprFloor(value);
+    const float fraction = value - lower;
+    return (long)lower + ((fraction > 0.5f || (fraction == 0.5f && (long long)lower % 2 != 0)) ? 1 : 0);
+}
+
+constexpr std::int16_t quantizeSigned16(const float &sample) {
+    const float clipped = sample < -1.0f ? -1.0f : sample > 1.0f ? 1.0f : sample;
+    return (std::int16_t)constexprLrint(clipped * 32767.0f);
+}
+
+// computeSampleValue with amplitude 1 and no phase or offset, like renderNote
+constexpr float bakedSampleValue(const Generator &generator, const int &sample, const float &frequency) {
+    switch (generator) {
+        case Generator::SquareWave:
+            return squareWaveValue(1.0f, constexprSin(sineArgument(sample, g_samplingFrequency, frequency, 0.0f)) + 0.0f);
+        case Generator::SawtoothWave:
+            return computeSampleValueSawtoothWave(sample, g_samplingFrequency, 1.0f, frequency, 0.0f, 0.0f);
+        default:
+            return sineWaveValue(1.0f, constexprSin(sineArgument(sample, g_samplingFrequency, frequency, 0.0f)), 0.0f);
+    }
+}
+
+struct BuiltinNote {
+    int midiKey;
+    int durationDivisor;
+};
+
+constexpr bool isSameNote(const BuiltinNote &a, const BuiltinNote &b) {
+    return a.midiKey == b.midiKey && a.durationDivisor == b.durationDivisor;
+}
+
+constexpr BuiltinNote g_alleMeineEntchen[] = {
+    {60, 8}, {62, 8}, {64, 8}, {65, 8}, {67, 4}, {67, 4},
+    {69, 8}, {69, 8}, {69, 8}, {69, 8}, {67, 2},
+    {69, 8}, {69, 8}, {69, 8}, {69, 8}, {67, 2},
+    {65, 8}, {65, 8}, {65, 8}, {65, 8}, {64, 4}, {64, 4},
+    {67, 8}, {67, 8}, {67, 8}, {67, 8}, {60, 2}
+};
+
+#ifdef BAKE_BUILTIN_SONGS
+template <int noteCount>
+constexpr int distinctNoteSamples(const BuiltinNote (&notes)[noteCount]) {
+    int sampleCount{};
+    for (int i = 0; i < noteCount; ++i) {
+        bool isRepeat = false;
+        for (int j = 0; j < i; ++j) {
+            isRepeat = isRepeat || isSameNote(notes[i], notes[j]);
+        }
+        sampleCount += isRepeat ? 0 : g_samplingFrequency / notes[i].durationDivisor;
+    }
+    return sampleCount;
+}
+
+// Note i is samples[clipStart[i]] on, a repeated note points at its first clip
+template <int noteCount, int sampleCount>
+struct BakedSong {
+    int clipStart[noteCount];
+    std::int16_t samples[sampleCount];
+};
+
+template <int sampleCount, int noteCount>
+constexpr BakedSong<noteCount, sampleCount> bakeSong(const BuiltinNote (&notes)[noteCount], const Generator &generator) {
+    BakedSong<noteCount, sampleCount> song{};
+    int nextSample{};
+    for (int i = 0; i < noteCount; ++i) {
+        song.clipStart[i] = -1;
+        for (int j = 0; j < i && song.clipStart[i] < 0; ++j) {
+            song.clipStart[i] = isSameNote(notes[i], notes[j]) ? song.clipStart[j] : -1;
+        }
+        if (song.clipStart[i] < 0) {
+            song.clipStart[i] = nextSample;
+            const int noteLength = g_samplingFrequency / notes[i].durationDivisor;
+            for (int sample = 0; sample < noteLength; ++sample) {
+                song.samples[nextSample++] = quantizeSigned16(bakedSampleValue(generator, sample, g_midiPitches[notes[i].midiKey]));
+            }
+        }
+    }
+    return song;
+}
+
+constexpr int g_alleMeineEntchenSamples = distinctNoteSamples(g_alleMeineEntchen);
+
+// one per Generator, in enum order
+constexpr BakedSong<sizeof(g_alleMeineEntchen) / sizeof(BuiltinNote), g_alleMeineEntchenSamples> g_alleMeineEntchenPcm[] = {
+    bakeSong<g_alleMeineEntchenSamples>(g_alleMeineEntchen, Generator::SquareWave),
+    bakeSong<g_alleMeineEntchenSamples>(g_alleMeineEntchen, Generator::SawtoothWave),
+    bakeSong<g_alleMeineEntchenSamples>(g_alleMeineEntchen, Generator::SineWave)
+};
+
+static_assert(g_alleMeineEntchenPcm[0].samples[0] == 32767 && g_alleMeineEntchenPcm[2].samples[0] == 0, "first samples");
+static_assert(g_alleMeineEntchenPcm[0].clipStart[26] == g_alleMeineEntchenSamples - g_samplingFrequency / 2,
+              "the last c is the last new note");
+#endif
+
+// The generator math at compile time
+static_assert(constexprSin(0.0) == 0.0 && constexprSin(M_PI / 2) > 0.9999999999, "sin(0) and sin(pi/2)");
+static_assert(constexprSin(-M_PI / 6) > -0.5000000001 && constexprSin(-M_PI / 6) < -0.4999999999, "sin(-pi/6)");
+static_assert(constexprSin(1000.5 * M_PI) > 0.9999999999, "sin of a large argument");
+static_assert(constexprLrint(2.5f) == 2 && constexprLrint(3.5f) == 4 && constexprLrint(-2.5f) == -2, "ties to even");
+static_assert(bakedSampleValue(Generator::SquareWave, 0, 440.0f) == 1.0f, "square waves start high");
+static_assert(bakedSampleValue(Generator::SquareWave, 10, 440.0f) == -1.0f, "440 Hz is past half a cycle at sample 10");
+static_assert(bakedSampleValue(Generator::SawtoothWave, 0, 440.0f) == 0.0f, "sawtooth waves start mid ramp");
+static_assert(bakedSampleValue(Generator::SineWave, 1, 2000.0f) > 0.9999999f, "2 kHz peaks at sample 1");
+
+template <int noteCount>
+std::vector<Note> builtinNotes(const BuiltinNote (&notes)[noteCount]) {
+    std::vector<Note> result;
+    for (const BuiltinNote &note : notes) {
+        result.push_back(Note(note.midiKey, note.durationDivisor, false, g_generator));
+    }
+    return result;
+}
+
+#ifdef BAKE_BUILTIN_SONGS
+// Same clips as playNotes, from the baked samples
+template <int noteCount, int sampleCount>
+void playBakedSong(const BuiltinNote (&notes)[noteCount], const BakedSong<noteCount, sampleCount> (&songs)[3]) {
+    if (g_sampleFormat != SampleFormat::Signed16) {
+        playNotes(builtinNotes(notes));
+        return;
+    }
+    const BakedSong<noteCount, sampleCount> &song = songs[(int)g_generator];
+    g_sink->beginStream(g_sampleFormat);
+    for (int i = 0; i < noteCount; ++i) {
+        const int noteLength = g_samplingFrequency / notes[i].durationDivisor;
+        g_sink->writeClip(noteKey(g_midiPitches[notes[i].midiKey], noteLength), [&]() {
+            std::vector<ALubyte> pcmData(noteLength * sizeof(std::int16_t));
+            std::memcpy(pcmData.data(), song.samples + song.clipStart[i], pcmData.size());
+            return pcmData;
+        });
+    }
+    g_sink->endStream();
+}
+
+// How many baked samples differ from what renderNote and quantizeSamples make at runtime
+template <int noteCount, int sampleCount>
+int countBakedMismatches(const BuiltinNote (&notes)[noteCount], const BakedSong<noteCount, sampleCount> (&songs)[3]) {
+    int mismatchCount{};
+    const Generator previousGenerator = g_generator;
+    for (int generator = 0; generator < 3; ++generator) {
+        g_generator = (Generator)generator;
+        for (int i = 0; i < noteCount; ++i) {
+            const int noteLength = g_samplingFrequency / notes[i].durationDivisor;
+            std::vector<float> samples(noteLength);
+            renderNote(samples.data(), 0, noteLength, g_midiPitches[notes[i].midiKey]);
+            const std::vector<ALubyte> pcmData = quantizeSamples(samples, SampleFormat::Signed16);
+            for (int sample = 0; sample < noteLength; ++sample) {
+                std::int16_t value{};
+                std::memcpy(&value, pcmData.data() + sample * sizeof(value), sizeof(value));
+                mismatchCount += value != songs[generator].samples[songs[generator].clipStart[i] + sample];
+            }
+        }
+    }
+    g_generator = previousGenerator;
+    return mismatchCount;
+}
+
+void playAlleMeineEntchen() {
+    playBakedSong(g_alleMeineEntchen, g_alleMeineEntchenPcm);
+}
+
+bool checkBuiltinSongs() {
+    const int mismatchCount = countBakedMismatches(g_alleMeineEntchen, g_alleMeineEntchenPcm);
+    std::cout << "alleMeineEntchen: " << mismatchCount << " baked samples differ from the runtime synthesis" << std::endl;
+    return mismatchCount == 0;
+}
+#else
+void playAlleMeineEntchen() {
+    playNotes(builtinNotes(g_alleMeineEntchen));
+}
+
+bool checkBuiltinSongs() {
+    std::cout << "Built-in songs are not baked, build with -DBAKE_BUILTIN_SONGS" << std::endl;
+    return true;
+}
+#endif
+
+// Whole token as a decimal integer
+bool parseScoreNumber(const std::string &token, int &value) {
+    char *end{};
+    const long long parsed = std::strtoll(token.c_str(), &end, 10);
+    value = (int)parsed;
+    return !token.empty() && *end == '\0' && parsed >= INT32_MIN && parsed <= INT32_MAX;
+}
+
+// NOTE: Notes are "c 4 8", "f# 5 4 sineWave", "+e 4 8" (chord tone) or "r 4" (rest). Octave 4 starts
+//       at middle C, a token starting with # comments out the rest of its line.
+bool loadScore(const std::string &fileName, std::vector<Note> &notes) {
+    std::ifstream file(fileName);
+    if (!file) {
+        std::cout << "Could not open " << fileName << std::endl;
+        return false;
+    }
+    const std::string noteLetters = "c d ef g a b";
+    std::string line;
+    int lineNumber{};
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        std::vector<std::string> tokens;
+        std::istringstream lineStream(line);
+        for (std::string token; lineStream >> token && token[0] != '#';) {
+            tokens.push_back(token);
+        }
+        auto fail = [&](const std::string &message) {
+            std::cout << fileName << ":" << lineNumber << ": " << message << std::endl;
+            return false;
+        };
+        for (std::size_t i{}; i < tokens.size();) {
+            const std::string &token = tokens[i++];
+            const bool isChordTone = token[0] == '+';
+            const std::string name = token.substr(isChordTone ? 1 : 0);
+            int midiKey = -1;
+            if (name != "r") {
+                const std::size_t semitone = name.empty() || name[0] == ' ' ? std::string::npos : noteLetters.find(name[0]);
+                const int accidental = name.size() == 2 ? (name[1] == '#' ? 1 : name[1] == 'b' ? -1 : 0) : 0;
+                if (semitone == std::string::npos || name.size() > 2 || (name.size() == 2 && accidental == 0)) {
+                    return fail("unknown note " + token);
+                }
+                int octave{};
+                if (i == tokens.size() || !parseScoreNumber(tokens[i++], octave)) {
+                    return fail("missing octave after " + token);
+                }
+                if (octave < -1 || octave > 9) {
+                    return fail(token + " " + tokens[i - 1] + " is outside the MIDI octaves -1 to 9");
+                }
+                midiKey = 12 * (octave + 1) + (int)semitone + accidental;
+                if (midiKey < 0 || midiKey > 127) {
+                    return fail(token + " " + tokens[i - 1] + " is outside the MIDI range");
+                }
+            }
+            int durationDivisor{};
+            if (i == tokens.size() || !parseScoreNumber(tokens[i++], durationDivisor)
+                || durationDivisor < 1 || durationDivisor > g_samplingFrequency) {
+                return fail("missing duration after " + token);
+            }
+            Generator generator = g_generator;
+            if (i < tokens.size() && tokens[i] == generatorName(parseGenerator(tokens[i]))) {
+                generator = parseGenerator(tokens[i++]);
+            }
+            notes.push_back(Note(midiKey, durationDivisor, isChordTone, generator));
+        }
+    }
+    return true;
+}
+
+// Read only view of a whole file. Pages are faulted in as the decoder touches them, so
+// nothing is copied into a userspace buffer first.
+struct MappedFile {
+    const std::uint8_t *data = nullptr;
+    std::size_t size = 0;
+    
+    explicit MappedFile(const std::string &fileName) {
+#ifdef _WIN32
+        file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER fileSize;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            return;
+        }
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) {
+            data = (const std::uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            size = data ? (std::size_t)fileSize.QuadPart : 0;
+        }
+#else
+        const int file = open(fileName.c_str(), O_RDONLY);
+        struct stat status;
+        if (file < 0) {
+            return;
+        }
+        if (fstat(file, &status) == 0 && status.st_size > 0) {
+            void *view = mmap(nullptr, (std::size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (view != MAP_FAILED) {
+                madvise(view, (std::size_t)status.st_size, MADV_SEQUENTIAL);
+                data = (const std::uint8_t *)view;
+                size = (std::size_t)status.st_size;
+            }
+        }
+        close(file);
+#endif
+    }
+    
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (data) munmap((void *)data, size);
+#endif
+    }
+    
+    // Drops the pages of a range that has been decoded already. They are clean, so this
+    // only gives the memory back, touching the range again would just fault it in again.
+    void release(const std::size_t &offset, const std::size_t &length) const {
+#ifndef _WIN32
+        const std::size_t pageSize = (std::size_t)sysconf(_SC_PAGESIZE);
+        const std::size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+        const std::size_t end = std::min(offset + length, size) / pageSize * pageSize;
+        if (data && begin < end) {
+            madvise((void *)(data + begin), end - begin, MADV_DONTNEED);
+        }
+#else
+        // the whole file stays mapped, its clean pages are the first the working set trimmer drops
+        (void)offset; (void)length;
+#endif
+    }
+    
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+struct FileInfo {
+    std::string path;
+    std::uint64_t size;
+    std::int64_t lastModified; // only comparable with other lastModified values
+    bool isDirectory;
+};
+
+bool statFile(const std::string &path, FileInfo &info) {
+    info.path = path;
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes)) {
+        return false;
+    }
+    info.size = ((std::uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+    info.lastModified = ((std::int64_t)attributes.ftLastWriteTime.dwHighDateTime << 32)
+                      | attributes.ftLastWriteTime.dwLowDateTime;
+    info.isDirectory = (attributes.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0) {
+        return false;
+    }
+    info.size = (std::uint64_t)status.st_size;
+    info.lastModified = (std::int64_t)status.st_mtime;
+    info.isDirectory = S_ISDIR(status.st_mode);
+#endif
+    return true;
+}
+
+// Creates directory if it doesn't exist yet, its parent has to exist
+void makeDirectory(const std::string &directory) {
+#ifdef _WIN32
+    CreateDirectoryA(directory.c_str(), nullptr);
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+}
+
+// Files in directory whose names end in extension, unsorted
+std::vector<FileInfo> listFiles(const std::string &directory, const std::string &extension) {
+    std::vector<std::string> names;
+#ifdef _WIN32
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA((directory + "/*" + extension).c_str(), &found);
+    if (search != INVALID_HANDLE_VALUE) {
+        do {
+            names.push_back(found.cFileName);
+        } while (FindNextFileA(search, &found));
+        FindClose(search);
+    }
+#else
+    if (DIR *handle = opendir(directory.c_str())) {
+        while (const dirent *found = readdir(handle)) {
+            names.push_back(found->d_name);
+        }
+        closedir(handle);
+    }
+#endif
+    std::vector<FileInfo> files;
+    for (const auto &name : names) {
+        FileInfo info;
+        if (name.size() >= extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0
+            && statFile(directory + "/" + name, info) && !info.isDirectory) {
+            files.push_back(info);
+        }
+    }
+    return files;
+}
+
+// Bounds checked reads through a Standard MIDI File, big endian. Reading past the end
+// returns zeros and clears isValid.
+struct MidiReader {
+    MidiReader(const std::uint8_t *data, const std::size_t &size) : data(data), size(size), position(0), isValid(true) {}
+    
+    std::uint8_t byte() {
+        if (position >= size) {
+            isValid = false;
+            return 0;
+        }
+        return data[position++];
+    }
+    
+    std::uint32_t bigEndian(const int &byteCount) {
+        std::uint32_t value{};
+        for (int i{}; i < byteCount; ++i) {
+            value = value << 8 | byte();
+        }
+        return value;
+    }
+    
+    // 7 bits per byte, high bit set on all but the last, at most 4 bytes
+    std::uint32_t variableLength() {
+        std::uint32_t value{};
+        for (int i{}; i < 4; ++i) {
+            const std::uint8_t next = byte();
+            value = value << 7 | (next & 0x7F);
+            if (!(next & 0x80)) {
+                return value;
+            }
+        }
+        isValid = false;
+        return value;
+    }
+    
+    void skip(const std::size_t &byteCount) {
+        if (byteCount > size - position) {
+            isValid = false;
+            position = size;
+            return;
+        }
+        position += byteCount;
+    }
+    
+    const std::uint8_t *data;
+    std::size_t size;
+    std::size_t position;
+    bool isValid;
+};
+
+// What the timeline needs from a track, in file order within the track
+struct MidiMessage {
+    enum Type { Tempo, NoteOff, NoteOn };
+    std::uint64_t tick;
+    Type type;
+    std::uint8_t channel;
+    std::uint8_t key;
+    std::uint8_t velocity;
+    std::uint32_t microsecondsPerQuarter;
+};
+
+const int g_midiPercussionChannel = 9;
+
+// Reads one MTrk chunk's events into messages, running status included
+bool readMidiTrack(MidiReader &reader, const std::size_t &end, std::vector<MidiMessage> &messages) {
+    std::uint64_t tick{};
+    std::uint8_t runningStatus{};
+    while (reader.position < end && reader.isValid) {
+        tick += reader.variableLength();
+        std::uint8_t status = reader.position < end ? reader.data[reader.position] : 0;
+        if (status & 0x80) {
+            ++reader.position;
+        } else if (runningStatus) {
+            status = runningStatus;
+        } else {
+            return false;
+        }
+        
+        if (status == 0xFF) {
+            const std::uint8_t type = reader.byte();
+            const std::uint32_t length = reader.variableLength();
+            if (type == 0x51 && length == 3) {
+                messages.push_back(MidiMessage{tick, MidiMessage::Tempo, 0, 0, 0, reader.bigEndian(3)});
+            } else {
+                reader.skip(length);
+            }
+            if (type == 0x2F) {
+                break; // end of track
+            }
+        } else if (status == 0xF0 || status == 0xF7) {
+            reader.skip(reader.variableLength());
+            runningStatus = 0;
+        } else if (status > 0xF0) {
+            return false; // system common and real time messages don't belong in files
+        } else {
+            runningStatus = status;
+            const std::uint8_t kind = status & 0xF0;
+            const std::uint8_t channel = status & 0x0F;
+            const std::uint8_t key = reader.byte();
+            const std::uint8_t velocity = (kind == 0xC0 || kind == 0xD0) ? 0 : reader.byte();
+            if ((kind == 0x80 || kind == 0x90) && key < 128) {
+                // note on with velocity 0 is a note off
+                const MidiMessage::Type type = kind == 0x90 && velocity > 0 ? MidiMessage::NoteOn : MidiMessage::NoteOff;
+                messages.push_back(MidiMessage{tick, type, channel, key, velocity, 0});
+            }
+        }
+    }
+    return reader.isValid;
+}
+
+// NOTE: Channel 10 is percussion without a pitch and is left out.
+bool loadMidiFile(const std::string &fileName, std::vector<NoteEvent> &events) {
+    const MappedFile file(fileName);
+    if (!file.data) {
+        std::cout << "Could not open " << fileName << std::endl;
+        return false;
+    }
+    MidiReader reader(file.data, file.size);
+    if (file.size < 14 || std::memcmp(file.data, "MThd", 4) != 0) {
+        std::cout << fileName << " is not a MIDI file" << std::endl;
+        return false;
+    }
+    reader.skip(4);
+    const std::uint32_t headerLength = reader.bigEndian(4);
+    const std::uint32_t format = reader.bigEndian(2);
+    const std::uint32_t trackCount = reader.bigEndian(2);
+    const std::uint32_t division = reader.bigEndian(2);
+    reader.skip(headerLength - 6);
+    // ticks per quarter note, or with the high bit set SMPTE frames per second and ticks per frame
+    const bool isSmpte = (division & 0x8000) != 0;
+    const double ticksPerSecond = isSmpte ? (double)(-(std::int8_t)(division >> 8)) * (division & 0xFF) : 0.0;
+    if (headerLength < 6 || (isSmpte ? ticksPerSecond <= 0.0 : division == 0)) {
+        std::cout << fileName << ": bad MIDI header" << std::endl;
+        return false;
+    }
+    
+    std::vector<MidiMessage> messages;
+    std::uint32_t tracksRead{};
+    while (tracksRead < trackCount && reader.position + 8 <= file.size) {
+        const bool isTrack = std::memcmp(file.data + reader.position, "MTrk", 4) == 0;
+        reader.skip(4);
+        const std::uint32_t length = reader.bigEndian(4);
+        const std::size_t end = reader.position + length;
+        if (end > file.size) {
+            break;
+        }
+        // other chunk types are allowed and skipped
+        if (isTrack) {
+            if (!readMidiTrack(reader, end, messages)) {
+                std::cout << fileName << ": bad MIDI track " << tracksRead << std::endl;
+                return false;
+            }
+            ++tracksRead;
+        }
+        reader.position = end;
+    }
+    if (tracksRead < trackCount) {
+        std::cout << fileName << ": " << tracksRead << " of " << trackCount << " tracks, file is truncated" << std::endl;
+        return false;
+    }
+    
+    // at the same tick tempo changes come first, and a note off before a note on, so a key
+    // struck again right away isn't ended by its own previous note off
+    std::stable_sort(messages.begin(), messages.end(), [](const MidiMessage &a, const MidiMessage &b) {
+        return a.tick < b.tick || (a.tick == b.tick && a.type < b.type);
+    });
+    
+    std::vector<std::deque<std::pair<int, std::uint8_t>>> openNotes(16 * 128);
+    std::uint32_t microsecondsPerQuarter = 500000;
+    std::uint64_t lastTick{};
+    double microseconds{};
+    int sample{};
+    events.clear();
+    auto endNote = [&](std::deque<std::pair<int, std::uint8_t>> &notes, const std::uint8_t &key) {
+        const int start = notes.front().first;
+        if (sample > start) {
+            events.push_back(NoteEvent{start, sample - start, g_midiPitches[key], notes.front().second / 127.0f, g_generator});
+        }
+        notes.pop_front();
+    };
+    for (const MidiMessage &message : messages) {
+        microseconds += (message.tick - lastTick) * (isSmpte ? 1e6 / ticksPerSecond : (double)microsecondsPerQuarter / division);
+        lastTick = message.tick;
+        sample = (int)std::llround(microseconds * g_samplingFrequency / 1e6);
+        if (message.type == MidiMessage::Tempo) {
+            microsecondsPerQuarter = message.microsecondsPerQuarter;
+            continue;
+        }
+        if (message.channel == g_midiPercussionChannel) {
+            continue;
+        }
+        auto &notes = openNotes[message.channel * 128 + message.key];
+        if (message.type == MidiMessage::NoteOn) {
+            notes.push_back(std::make_pair(sample, message.velocity));
+        } else if (!notes.empty()) {
+            endNote(notes, message.key);
+        }
+    }
+    // notes still held at the end stop with the last event
+    for (std::size_t slot{}; slot < openNotes.size(); ++slot) {
+        while (!openNotes[slot].empty()) {
+            endNote(openNotes[slot], (std::uint8_t)(slot % 128));
+        }
+    }
+    std::stable_sort(events.begin(), events.end(), [](const NoteEvent &a, const NoteEvent &b) {
+        return a.startSample < b.startSample;
+    });
+    std::cout << fileName << ": format " << format << ", " << trackCount << " tracks, " << events.size() << " notes" << std::endl;
+    return true;
+}
+
+// Decoded bitmap with rows top to bottom and one plane per channel, pixel (x, y) is at y*width+x
+struct Bitmap {
+    int width = 0;
+    int height = 0;
+    std::vector<std::uint8_t> r;
+    std::vector<std::uint8_t> g;
+    std::vector<std::uint8_t> b;
+};
+
+template <typename T>
+T readLittleEndian(const std::uint8_t *bytes) {
+    T value;
+    std::memcpy(&value, bytes, sizeof(value)); // NOTE: BMP is little endian, so are all our targets
+    return value;
+}
+
+// Scalar deinterleave of one row, also finishes the pixels the SIMD kernels leave over
+void deinterleaveRowScalar(const std::uint8_t *row, const int &bytesPerPixel, const int &first, const int &width,
+                           std::uint8_t *r, std::uint8_t *g, std::uint8_t *b) {
+    for (int x = first; x < width; ++x) {
+        const std::uint8_t *pixel = row + x*bytesPerPixel;
+        b[x] = pixel[0];
+        g[x] = pixel[1];
+        r[x] = pixel[2];
+    }
+}
+
+#if SIMD_X86
+// 16 BGR pixels per iteration: each output plane gathers its bytes from the three input
+// vectors with one shuffle per vector, lanes that belong to another vector shuffle to zero.
+TARGET_SSE41 int deinterleaveRow24Sse41(const std::uint8_t *row, const int &width,
+                                        std::uint8_t *r, std::uint8_t *g, std::uint8_t *b) {
+    __m128i masks[3][3];
+    for (int channel{}; channel < 3; ++channel) {
+        for (int source{}; source < 3; ++source) {
+            alignas(16) std::int8_t mask[16];
+            for (int pixel{}; pixel < 16; ++pixel) {
+                const int index = 3*pixel + channel - 16*source;
+                mask[pixel] = (index >= 0 && index < 16) ? (std::int8_t)index : (std::int8_t)-128;
+            }
+            masks[channel][source] = _mm_load_si128((const __m128i *)mask);
+        }
+    }
+    std::uint8_t *planes[3] = {b, g, r};
+    int x{};
+    for (; x + 16 <= width; x += 16) {
+        const __m128i first = _mm_loadu_si128((const __m128i *)(row + 3*x));
+        const __m128i second = _mm_loadu_si128((const __m128i *)(row + 3*x + 16));
+        const __m128i third = _mm_loadu_si128((const __m128i *)(row + 3*x + 32));
+        for (int channel{}; channel < 3; ++channel) {
+            const __m128i plane = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(first, masks[channel][0]),
+                                                            _mm_shuffle_epi8(second, masks[channel][1])),
+                                               _mm_shuffle_epi8(third, masks[channel][2]));
+            _mm_storeu_si128((__m128i *)(planes[channel] + x), plane);
+        }
+    }
+    return x;
+}
+
+// 16 BGRA pixels per iteration: group each vector by channel, then a 4x4 transpose of the
+// 32 bit groups yields whole planes
+TARGET_SSE41 int deinterleaveRow32Sse41(const std::uint8_t *row, const int &width,
+                                        std::uint8_t *r, std::uint8_t *g, std::uint8_t *b) {
+    const __m128i byChannel = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    int x{};
+    for (; x + 16 <= width; x += 16) {
+        const __m128i v0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(row + 4*x)), byChannel);
+        const __m128i v1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(row + 4*x + 16)), byChannel);
+        const __m128i v2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(row + 4*x + 32)), byChannel);
+        const __m128i v3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(row + 4*x + 48)), byChannel);
+        const __m128i blueGreenLow = _mm_unpacklo_epi32(v0, v1);
+        const __m128i blueGreenHigh = _mm_unpacklo_epi32(v2, v3);
+        const __m128i redAlphaLow = _mm_unpackhi_epi32(v0, v1);
+        const __m128i redAlphaHigh = _mm_unpackhi_epi32(v2, v3);
+        _mm_storeu_si128((__m128i *)(b + x), _mm_unpacklo_epi64(blueGreenLow, blueGreenHigh));
+        _mm_storeu_si128((__m128i *)(g + x), _mm_unpackhi_epi64(blueGreenLow, blueGreenHigh));
+        _mm_storeu_si128((__m128i *)(r + x), _mm_unpacklo_epi64(redAlphaLow, redAlphaHigh));
+    }
+    return x;
+}
+#endif
+
+struct BitmapHeader {
+    int width;
+    int height;
+    int bytesPerPixel;
+    bool isBottomUp;
+    std::size_t dataOffset;
+    std::size_t stride;
+};
+
+// Uncompressed 24 and 32 bit BMPs, bottom up or top down. 32 bit may be BI_BITFIELDS as long
+// as the masks are the plain BGRA ones, alpha is ignored.
+bool readBitmapHeader(const MappedFile &file, const std::string &fileName, BitmapHeader &header) {
+    if (!file.data) {
+        std::cout << "Could not open " << fileName << std::endl;
+        return false;
+    }
+    const std::size_t fileHeaderSize = 14;
+    const std::uint8_t *bytes = file.data;
+    if (file.size < fileHeaderSize + 40 || bytes[0] != 'B' || bytes[1] != 'M') {
+        std::cout << fileName << " is not a BMP file" << std::endl;
+        return false;
+    }
+    const std::uint32_t dataOffset = readLittleEndian<std::uint32_t>(bytes + 10);
+    const std::uint32_t infoHeaderSizeInBytes = readLittleEndian<std::uint32_t>(bytes + 14);
+    const std::int32_t width = readLittleEndian<std::int32_t>(bytes + 18);
+    const std::int32_t signedHeight = readLittleEndian<std::int32_t>(bytes + 22);
+    const std::uint16_t planes = readLittleEndian<std::uint16_t>(bytes + 26);
+    const std::uint16_t bitsPerPixel = readLittleEndian<std::uint16_t>(bytes + 28);
+    const std::uint32_t compression = readLittleEndian<std::uint32_t>(bytes + 30);
+    
+    const std::uint32_t BI_RGB = 0;
+    const std::uint32_t BI_BITFIELDS = 3;
+    bool hasPlainMasks = compression == BI_RGB;
+    if (compression == BI_BITFIELDS && bitsPerPixel == 32 && file.size >= fileHeaderSize + 40 + 12) {
+        hasPlainMasks = readLittleEndian<std::uint32_t>(bytes + 54) == 0x00FF0000
+                     && readLittleEndian<std::uint32_t>(bytes + 58) == 0x0000FF00
+                     && readLittleEndian<std::uint32_t>(bytes + 62) == 0x000000FF;
+    }
+    if (infoHeaderSizeInBytes < 40 || planes != 1 || (bitsPerPixel != 24 && bitsPerPixel != 32) || !hasPlainMasks) {
+        std::cout << fileName << ": unsupported BMP (info header " << infoHeaderSizeInBytes << " bytes, "
+                  << bitsPerPixel << " bit, compression " << compression << ")" << std::endl;
+        return false;
+    }
+    const bool isBottomUp = signedHeight > 0;
+    const std::int64_t height = isBottomUp ? signedHeight : -(std::int64_t)signedHeight;
+    // rows are padded to 4 bytes
+    const std::int64_t bytesPerPixel = bitsPerPixel / 8;
+    const std::int64_t stride = (width * bytesPerPixel + 3) / 4 * 4;
+    // the pixel data size is never multiplied out, stride * height can overflow on a crafted file
+    if (width <= 0 || height <= 0 || height > INT32_MAX || dataOffset < fileHeaderSize + infoHeaderSizeInBytes
+        || dataOffset > file.size || (std::uint64_t)stride > (file.size - dataOffset) / (std::uint64_t)height) {
+        std::cout << fileName << ": bad BMP dimensions " << width << "x" << height
+                  << " for " << file.size << " bytes" << std::endl;
+        return false;
+    }
+    
+    header.width = width;
+    header.height = (int)height;
+    header.bytesPerPixel = (int)bytesPerPixel;
+    header.isBottomUp = isBottomUp;
+    header.dataOffset = dataOffset;
+    header.stride = (std::size_t)stride;
+    if (g_doLog) {
+        std::cout << fileName << ": " << width << "x" << height << ", " << bitsPerPixel << " bit, "
+                  << (isBottomUp ? "bottom up" : "top down") << std::endl;
+    }
+    return true;
+}
+
+// Decodes image rows [firstRow, firstRow + rowCount) (counted from the top) into rows
+void decodeBitmapRows(const MappedFile &file, const BitmapHeader &header, const int &firstRow,
+                      const int &rowCount, Bitmap &rows) {
+    const int width = header.width;
+    rows.width = width;
+    rows.height = rowCount;
+    const std::size_t pixelCount = (std::size_t)width * (std::size_t)rowCount;
+    rows.r.resize(pixelCount);
+    rows.g.resize(pixelCount);
+    rows.b.resize(pixelCount);
+    for (int y{}; y < rowCount; ++y) {
+        const int imageRow = firstRow + y;
+        const std::size_t fileRow = header.isBottomUp ? header.height - 1 - imageRow : imageRow;
+        const std::uint8_t *row = file.data + header.dataOffset + fileRow * header.stride;
+        std::uint8_t *r = &rows.r[(std::size_t)y * width];
+        std::uint8_t *g = &rows.g[(std::size_t)y * width];
+        std::uint8_t *b = &rows.b[(std::size_t)y * width];
+        int done{};
+#if SIMD_X86
+        if (g_simdLevel != SimdLevel::Scalar) {
+            done = header.bytesPerPixel == 3 ? deinterleaveRow24Sse41(row, width, r, g, b)
+                                             : deinterleaveRow32Sse41(row, width, r, g, b);
+        }
+#endif
+        deinterleaveRowScalar(row, header.bytesPerPixel, done, width, r, g, b);
+    }
+}
+
+bool decodeBitmap(const std::string &fileName, Bitmap &bitmap) {
+    const MappedFile file(fileName);
+    BitmapHeader header;
+    if (!readBitmapHeader(file, fileName, header)) {
+        return false;
+    }
+    decodeBitmapRows(file, header, 0, header.height, bitmap);
+    return true;
+}
+
+// Runs task(index) for every index in [0, count) on up to threadCount threads, the calling
+// thread included. Indices are handed out one at a time, so uneven tasks still keep every
+// thread busy until the end.
+template <typename Task>
+void parallelFor(const int &count, const int &threadCount, const Task &task) {
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for (int index = next++; index < count; index = next++) {
+            task(index);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int thread = 1; thread < std::min(threadCount, count); ++thread) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+// NOTE: One entry per audible pixel, as structure of arrays so the sample loop streams contiguous floats.
+struct OscillatorBank {
+    std::vector<float> frequencies;
+    std::vector<float> amplitudes;
+    std::vector<float> phases;
+    std::vector<float> offsets;
+    // Pixels behind the oscillators, more than size() once pixels are folded together
+    std::size_t pixelCount = 0;
+
+    std::size_t size() const {
+        return frequencies.size();
+    }
+
+    void reserve(const std::size_t &count) {
+        frequencies.reserve(count);
+        amplitudes.reserve(count);
+        phases.reserve(count);
+        offsets.reserve(count);
+    }
+};
+
+// Loudness of a pixel, false for white pixels which stay silent
+bool pixelAmplitude(const std::uint8_t &red, const std::uint8_t &green, const std::uint8_t &blue, float &amplitude) {
+    if (red == 255 && green == 255 && blue == 255) {
+        return false;
+    }
+    amplitude = red / 255.0f;
+    return true;
+}
+
+// Maps pixel (x, y) to its oscillator, false for pixels that stay silent
+bool pixelOscillator(const int &x, const int &y, const int &height, const std::uint8_t &red,
+                     const std::uint8_t &green, const std::uint8_t &blue, float &signalFrequency,
+                     float &amplitude, float &phase, float &offset) {
+    if (!pixelAmplitude(red, green, blue, amplitude)) {
+        return false;
+    }
+    signalFrequency = x;
+    if (signalFrequency == 0) {
+        return false;
+    }
+    phase = (y/height) * 1.f/signalFrequency; // TODO(moritz): think about phase handling that makes more sense
+    offset = 0.0f;
+    if (green || blue) {
+        offset = (1.0f - amplitude) * (1.0f / (green + blue));
+    }
+    return true;
+}
+
+OscillatorBank compileOscillatorBank(const Bitmap &bitmap) {
+    OscillatorBank bank;
+    bank.reserve(bitmap.r.size());
+    const int width = bitmap.width;
+    const int height = bitmap.height;
+    for (int y{}; y < height; ++y) {
+        for (int x{}; x < width; ++x) {
+            const std::size_t pixel = (std::size_t)y*width + x;
+            float signalFrequency, amplitude, phase, offset;
+            if (pixelOscillator(x, y, height, bitmap.r[pixel], bitmap.g[pixel], bitmap.b[pixel],
+                                signalFrequency, amplitude, phase, offset)) {
+                bank.frequencies.push_back(signalFrequency);
+                bank.amplitudes.push_back(amplitude);
+                bank.phases.push_back(phase);
+                bank.offsets.push_back(offset);
+            }
+        }
+    }
+    bank.pixelCount = bank.size();
+    return bank;
+}
+
+// NOTE: Square wave offsets are rounded to g_squareOffsetSteps values to fold, so streamed square waves
+//       only approximate unstreamed ones.
+const int g_squareOffsetSteps = 64;
+
+struct OscillatorFolder {
+    Generator generator;
+    int height;
+    int slotsPerColumn;
+    // bank index of column x, offset step s at x*slotsPerColumn + s, -1 while unused
+    std::vector<std::int32_t> slots;
+    std::vector<double> amplitudeSums;
+    std::vector<double> offsetSums;
+    OscillatorBank bank;
+    
+    OscillatorFolder(const Generator &generator, const int &width, const int &height) :
+        generator(generator),
+        height(height),
+        slotsPerColumn(generator == Generator::SquareWave ? g_squareOffsetSteps : 1),
+        slots((std::size_t)width * slotsPerColumn, -1)
+    {}
+    
+    // rows holds image rows starting at firstRow
+    void fold(const Bitmap &rows, const int &firstRow) {
+        for (int y{}; y < rows.height; ++y) {
+            for (int x{}; x < rows.width; ++x) {
+                const std::size_t pixel = (std::size_t)y*rows.width + x;
+                float signalFrequency, amplitude, phase, offset;
+                if (!pixelOscillator(x, firstRow + y, height, rows.r[pixel], rows.g[pixel], rows.b[pixel],
+                                     signalFrequency, amplitude, phase, offset)) {
+                    continue;
+                }
+                assert(phase == 0.0f);
+                int step{};
+                if (generator == Generator::SquareWave) {
+                    step = (int)std::lrint(std::min(std::max(offset, 0.0f), 1.0f) * (g_squareOffsetSteps - 1));
+                }
+                std::int32_t &slot = slots[(std::size_t)x * slotsPerColumn + step];
+                if (slot < 0) {
+                    slot = (std::int32_t)bank.size();
+                    bank.frequencies.push_back(signalFrequency);
+                    bank.amplitudes.push_back(0.0f);
+                    bank.phases.push_back(phase);
+                    bank.offsets.push_back((float)step / (g_squareOffsetSteps - 1));
+                    amplitudeSums.push_back(0.0);
+                    offsetSums.push_back(0.0);
+                }
+                amplitudeSums[slot] += amplitude;
+                offsetSums[slot] += offset;
+                ++bank.pixelCount;
+            }
+        }
+    }
+    
+    OscillatorBank finish() {
+        for (std::size_t i{}; i < bank.size(); ++i) {
+            bank.amplitudes[i] = (float)amplitudeSums[i];
+            if (generator != Generator::SquareWave) {
+                bank.offsets[i] = (float)offsetSums[i];
+            }
+        }
+        return bank;
+    }
+};
+
+// Decodes the image stripRows rows at a time and folds every strip before the next one,
+// so only one strip of pixels is ever held.
+bool streamOscillatorBank(const std::string &fileName, const int &stripRows, const Generator &generator,
+                          OscillatorBank &bank) {
+    const MappedFile file(fileName);
+    BitmapHeader header;
+    if (!readBitmapHeader(file, fileName, header)) {
+        return false;
+    }
+    OscillatorFolder folder(generator, header.width, header.height);
+    Bitmap strip;
+    for (int firstRow{}; firstRow < header.height; firstRow += stripRows) {
+        const int rowCount = std::min(stripRows, header.height - firstRow);
+        decodeBitmapRows(file, header, firstRow, rowCount, strip);
+        folder.fold(strip, firstRow);
+        const int lowestFileRow = header.isBottomUp ? header.height - firstRow - rowCount : firstRow;
+        file.release(header.dataOffset + (std::size_t)lowestFileRow * header.stride, rowCount * header.stride);
+    }
+    bank = folder.finish();
+    return true;
+}
+
+// Value to add to a bank's sum for the -1 per pixel that folded oscillators only carry once
+double foldedShift(const OscillatorBank &bank, const Generator &generator) {
+    if (generator == Generator::SineWave) {
+        return 0.0;
+    }
+    return (double)bank.size() - (double)bank.pixelCount;
+}
+
+// Oscillators per slice in renderOscillatorBank. Fixed, so the order of the float
+// additions, and with it the output, never depends on the thread count.
+const std::size_t g_oscillatorSliceSize = 4096;
+
+// Every sample is the average of all pixels' sample values.
+// An empty bank (all white image) renders as silence. Renders samples
+// [firstSample, firstSample + sampleCount), the same blocks come out bit for bit
+// whatever range they are rendered in as long as firstSample is a multiple of
+// g_oscillatorSeekInterval.
+template <Generator generator>
+std::vector<float> renderOscillatorBank(const OscillatorBank &bank, const int &sampleCount, const int &firstSample,
+                                        const int &threadCount) {
+    std::vector<float> samples(sampleCount, 0.0f);
+    const std::size_t oscillatorCount = bank.size();
+    if (oscillatorCount == 0) {
+        return samples;
+    }
+    
+    // Oscillator by oscillator over blocks of samples. One second only has 8 blocks, so
+    // the oscillators are also split into slices to give every thread work. Each slice
+    // sums into its own row, the rows are added up in order afterwards.
+    const BlockKernel kernel = selectBlockKernel<generator>(g_simdLevel);
+    const int blockCount = (sampleCount + g_oscillatorSeekInterval - 1) / g_oscillatorSeekInterval;
+    const int sliceCount = (int)((oscillatorCount + g_oscillatorSliceSize - 1) / g_oscillatorSliceSize);
+    std::vector<float> sums((std::size_t)sliceCount * sampleCount);
+    parallelFor(blockCount * sliceCount, threadCount, [&](const int &task) {
+        const int block = task / sliceCount;
+        const int slice = task % sliceCount;
+        const int blockStart = block * g_oscillatorSeekInterval;
+        const int blockLength = std::min(g_oscillatorSeekInterval, sampleCount - blockStart);
+        float *sliceSums = &sums[(std::size_t)slice * sampleCount + blockStart];
+        const std::size_t end = std::min(oscillatorCount, (slice + 1) * g_oscillatorSliceSize);
+        for (std::size_t i = slice * g_oscillatorSliceSize; i < end; ++i) {
+            kernel(bank.amplitudes[i], bank.frequencies[i], bank.phases[i], bank.offsets[i],
+                   firstSample + blockStart, blockLength, sliceSums);
+        }
+    });
+    const double shift = foldedShift(bank, generator);
+    for (int sample{}; sample < sampleCount; ++sample) {
+        double sum = shift;
+        for (int slice{}; slice < sliceCount; ++slice) {
+            sum += sums[(std::size_t)slice * sampleCount + sample];
+        }
+        samples[sample] = (float)(sum / bank.pixelCount);
+    }
+    return samples;
+}
+
+std::vector<float> renderOscillatorBank(const OscillatorBank &bank, const int &sampleCount,
+                                        const Generator &generator, const int &firstSample, const int &threadCount) {
+    switch (generator) {
+        case Generator::SquareWave:
+            return renderOscillatorBank<Generator::SquareWave>(bank, sampleCount, firstSample, threadCount);
+        case Generator::SawtoothWave:
+            return renderOscillatorBank<Generator::SawtoothWave>(bank, sampleCount, firstSample, threadCount);
+        default:
+            return renderOscillatorBank<Generator::SineWave>(bank, sampleCount, firstSample, threadCount);
+    }
+}
+
+// NOTE: Sines of one frequency sum to one sine, so sineWave folds to one amplitude/phase pair per column.
+//       Square and sawtooth only merge pixels of equal phase.
+struct ColumnBank {
+    std::vector<float> frequencies;
+    std::vector<float> amplitudes;
+    std::vector<float> phases;
+    float offset;
+    std::size_t pixelCount;
+};
+
+ColumnBank mergeColumns(const OscillatorBank &bank) {
+    std::map<float, std::size_t> slots;
+    std::vector<double> real;
+    std::vector<double> imag;
+    double offset{};
+    for (std::size_t i{}; i < bank.size(); ++i) {
+        auto slot = slots.find(bank.frequencies[i]);
+        if (slot == slots.end()) {
+            slot = slots.insert(std::make_pair(bank.frequencies[i], real.size())).first;
+            real.push_back(0.0);
+            imag.push_back(0.0);
+        }
+        real[slot->second] += bank.amplitudes[i] * std::cos(bank.phases[i]);
+        imag[slot->second] += bank.amplitudes[i] * std::sin(bank.phases[i]);
+        offset += bank.offsets[i];
+    }
+    
+    ColumnBank columns;
+    columns.frequencies.reserve(slots.size());
+    columns.amplitudes.reserve(slots.size());
+    columns.phases.reserve(slots.size());
+    for (const auto &slot : slots) {
+        const double re = real[slot.second];
+        const double im = imag[slot.second];
+        columns.frequencies.push_back(slot.first);
+        columns.amplitudes.push_back(std::sqrt(re*re + im*im));
+        columns.phases.push_back(std::atan2(im, re));
+    }
+    columns.offset = offset;
+    columns.pixelCount = bank.pixelCount;
+    return columns;
+}
+
+// Reproduces the averaging of renderOscillatorBank with the sineWave generator. The
+// only difference is float rounding, far below even 16 bit quantization.
+std::vector<float> renderColumnBank(const ColumnBank &columns, const int &sampleCount, const int &firstSample,
+                                    const int &threadCount) {
+    std::vector<float> samples(sampleCount, 0.0f);
+    if (columns.pixelCount == 0) {
+        return samples;
+    }
+    
+    const double pixelCount = columns.pixelCount;
+    const std::size_t columnCount = columns.frequencies.size();
+    const int blockCount = (sampleCount + g_oscillatorSeekInterval - 1) / g_oscillatorSeekInterval;
+    parallelFor(blockCount, threadCount, [&](const int &block) {
+        const int blockEnd = std::min((block + 1) * g_oscillatorSeekInterval, sampleCount);
+        for (int sample = block * g_oscillatorSeekInterval; sample < blockEnd; ++sample) {
+            const float t = (float)(firstSample + sample) / (float)g_samplingFrequency;
+            double sum = columns.offset;
+            for (std::size_t i{}; i < columnCount; ++i) {
+                sum += columns.amplitudes[i] * std::sin(2.0f*M_PI*columns.frequencies[i]*t + columns.phases[i]);
+            }
+            samples[sample] = (float)(sum / pixelCount);
+        }
+    });
+    return samples;
+}
+
+// Recursive Cooley-Tukey that splits by the smallest prime factor, so 8000 = 2^6 * 5^3
+// runs as radix-2 and radix-5 passes. Sizes with large prime factors still work but
+// degrade towards O(n^2). twiddles holds e^(+-2*pi*i*j/N) for the top level size N.
+void fftRecursive(const std::complex<double> *input, const std::size_t &n, const std::size_t &stride,
+                  std::complex<double> *output, const std::complex<double> *twiddles,
+                  const std::size_t &twiddleStride) {
+    if (n == 1) {
+        output[0] = input[0];
+        return;
+    }
+    
+    std::size_t radix = 2;
+    while (n % radix != 0) {
+        radix = radix*radix > n ? n : radix + 1;
+    }
+    const std::size_t m = n / radix;
+    for (std::size_t r{}; r < radix; ++r) {
+        fftRecursive(input + r*stride, m, stride*radix, output + r*m, twiddles, twiddleStride*radix);
+    }
+    
+    std::complex<double> smallButterfly[8];
+    std::vector<std::complex<double>> largeButterfly(radix > 8 ? radix : 0);
+    std::complex<double> *butterfly = radix > 8 ? largeButterfly.data() : smallButterfly;
+    for (std::size_t k{}; k < m; ++k) {
+        for (std::size_t q{}; q < radix; ++q) {
+            std::complex<double> value;
+            for (std::size_t r{}; r < radix; ++r) {
+                value += output[r*m + k] * twiddles[((r*(k + q*m)) % n) * twiddleStride];
+            }
+            butterfly[q] = value;
+        }
+        for (std::size_t q{}; q < radix; ++q) {
+            output[k + q*m] = butterfly[q];
+        }
+    }
+}
+
+// Out of place and unnormalized, input read with the given stride.
+void fft(const std::complex<double> *input, const std::size_t &n, const std::size_t &stride,
+         std::complex<double> *output, const bool &inverse) {
+    const double sign = inverse ? 1.0 : -1.0;
+    std::vector<std::complex<double>> twiddles(n);
+    for (std::size_t j{}; j < n; ++j) {
+        twiddles[j] = std::polar(1.0, sign * 2.0*M_PI * (double)j / (double)n);
+    }
+    fftRecursive(input, n, stride, output, twiddles.data(), 1);
+}
+
+// NOTE: With one second of samples column x lands exactly on DFT bin x. Returns false if a frequency
+//       is not on a bin.
+bool renderColumnBankFft(const ColumnBank &columns, std::vector<float> &frame) {
+    const std::size_t frameSize = g_samplingFrequency;
+    for (const auto &frequency : columns.frequencies) {
+        if (frequency != std::floor(frequency) || frequency < 0.0f) {
+            return false;
+        }
+    }
+    
+    frame.assign(frameSize, 0.0f);
+    if (columns.pixelCount == 0) {
+        return true;
+    }
+    
+    // A*sin(wt + P) is the real part of A*e^(i(P - pi/2)) * e^(iwt)
+    std::vector<std::complex<double>> spectrum(frameSize);
+    for (std::size_t i{}; i < columns.frequencies.size(); ++i) {
+        const std::size_t bin = (std::size_t)columns.frequencies[i] % frameSize;
+        spectrum[bin] += std::polar((double)columns.amplitudes[i], columns.phases[i] - M_PI/2.0);
+    }
+    std::vector<std::complex<double>> signal(frameSize);
+    fft(spectrum.data(), frameSize, 1, signal.data(), true);
+    
+    const double pixelCount = columns.pixelCount;
+    for (std::size_t sample{}; sample < frameSize; ++sample) {
+        frame[sample] = (float)((signal[sample].real() + columns.offset) / pixelCount);
+    }
+    return true;
+}
+
+// NOTE: Table k serves frequencies up to 2^k Hz and holds only the harmonics below Nyquist there.
+const int g_wavetableBits = 13;
+const int g_wavetableSize = 1 << g_wavetableBits;
+const int g_wavetableStride = g_wavetableSize + 1;
+
+struct Wavetables {
+    int octaveCount;
+    std::vector<float> ramp;
+    std::vector<float> square;
+};
+
+void fillWavetable(float *table, const int &harmonicCount, const bool &oddOnly, const double &scale) {
+    // sum_n scale/n * sin(2*pi*n*x) is the real part of -i*scale/n * e^(i*2*pi*n*x)
+    std::vector<std::complex<double>> spectrum(g_wavetableSize);
+    spectrum[0] = 0.5;
+    for (int n = 1; n <= harmonicCount; ++n) {
+        if (!oddOnly || n % 2 == 1) {
+            spectrum[n] = std::complex<double>(0.0, -scale / n);
+        }
+    }
+    std::vector<std::complex<double>> values(g_wavetableSize);
+    fft(spectrum.data(), g_wavetableSize, 1, values.data(), true);
+    for (int i{}; i < g_wavetableStride; ++i) {
+        table[i] = (float)values[i % g_wavetableSize].real();
+    }
+}
+
+const Wavetables &wavetables() {
+    static const Wavetables tables = []() {
+        Wavetables result;
+        const int nyquist = g_samplingFrequency / 2;
+        result.octaveCount = 1;
+        while ((1 << (result.octaveCount - 1)) < nyquist) {
+            ++result.octaveCount;
+        }
+        result.ramp.resize(result.octaveCount * g_wavetableStride);
+        result.square.resize(result.octaveCount * g_wavetableStride);
+        for (int octave{}; octave < result.octaveCount; ++octave) {
+            const int topFrequency = 1 << octave;
+            const int harmonicCount = (nyquist + topFrequency - 1) / topFrequency - 1;
+            fillWavetable(&result.ramp[octave * g_wavetableStride], harmonicCount, false, -1.0/M_PI);
+            fillWavetable(&result.square[octave * g_wavetableStride], harmonicCount, true, 2.0/M_PI);
+        }
+        return result;
+    }();
+    return tables;
+}
+
+int wavetableOctave(const float &frequency, const int &octaveCount) {
+    int octave{};
+    while (octave < octaveCount - 1 && (float)(1 << octave) < frequency) {
+        ++octave;
+    }
+    return octave;
+}
+
+// Phases are 32 bit fixed point turns, so accumulators wrap for free and the top
+// g_wavetableBits are the table index
+const int g_wavetableFractionBits = 32 - g_wavetableBits;
+
+std::uint32_t wavetablePhase(const double &turns) {
+    return (std::uint32_t)(std::uint64_t)((turns - std::floor(turns)) * 4294967296.0);
+}
+
+// Linear between the two table points around phase
+inline float readWavetable(const float *table, const std::uint32_t &phase) {
+    const std::uint32_t index = phase >> g_wavetableFractionBits;
+    const float t = (float)(phase & ((1u << g_wavetableFractionBits) - 1)) * (1.0f / (1u << g_wavetableFractionBits));
+    return table[index] + t * (table[index + 1] - table[index]);
+}
+
+// NOTE: A square wave with an offset is a pulse of duty 0.5 + asin(offset)/pi, made of two band-limited ramps.
+struct WavetableBank {
+    std::vector<const float*> tables;
+    std::vector<float> startTurns;
+    std::vector<float> duties;
+    // wavetablePhase(duty), how far the trailing ramp of a pulse is behind
+    std::vector<std::uint32_t> dutyPhases;
+};
+
+WavetableBank compileWavetableBank(const OscillatorBank &bank, const Generator &generator) {
+    const Wavetables &tables = wavetables();
+    WavetableBank wavetableBank;
+    wavetableBank.tables.reserve(bank.size());
+    wavetableBank.startTurns.reserve(bank.size());
+    wavetableBank.duties.reserve(bank.size());
+    wavetableBank.dutyPhases.reserve(bank.size());
+    for (std::size_t i{}; i < bank.size(); ++i) {
+        const int octave = wavetableOctave(bank.frequencies[i], tables.octaveCount);
+        if (generator == Generator::SquareWave) {
+            const double shift = std::asin(std::min(std::max((double)bank.offsets[i], -1.0), 1.0));
+            const double duty = 0.5 + shift / M_PI;
+            const bool isSquare = duty == 0.5;
+            wavetableBank.tables.push_back(&(isSquare ? tables.square : tables.ramp)[octave * g_wavetableStride]);
+            wavetableBank.startTurns.push_back(bank.phases[i] / (2.0*M_PI) + shift / (2.0*M_PI));
+            wavetableBank.duties.push_back(duty);
+            wavetableBank.dutyPhases.push_back(wavetablePhase(duty));
+        } else {
+            // sawtoothWaveValue rises from 0.5 at cycle 0, that is ramp(cycle + 0.5)
+            wavetableBank.tables.push_back(&tables.ramp[octave * g_wavetableStride]);
+            wavetableBank.startTurns.push_back((double)bank.phases[i] * bank.frequencies[i] + 0.5);
+            wavetableBank.duties.push_back(0.5f);
+            wavetableBank.dutyPhases.push_back(wavetablePhase(0.5));
+        }
+    }
+    return wavetableBank;
+}
+
+#if SIMD_X86
+// 8 phases at a time, table points come in with two gathers. The float operations are the
+// scalar readWavetable's in the same order, so the sums come out the same.
+TARGET_AVX2 inline __m256 readWavetableAvx2(const float *table, const __m256i &phases) {
+    const __m256i index = _mm256_srli_epi32(phases, g_wavetableFractionBits);
+    const __m256 fraction = _mm256_cvtepi32_ps(_mm256_and_si256(phases, _mm256_set1_epi32((1 << g_wavetableFractionBits) - 1)));
+    const __m256 t = _mm256_mul_ps(fraction, _mm256_set1_ps(1.0f / (1u << g_wavetableFractionBits)));
+    const __m256 p0 = _mm256_i32gather_ps(table, index, 4);
+    const __m256 p1 = _mm256_i32gather_ps(table + 1, index, 4);
+    return _mm256_add_ps(p0, _mm256_mul_ps(t, _mm256_sub_ps(p1, p0)));
+}
+
+TARGET_AVX2 inline __m256i wavetablePhasesAvx2(const std::uint32_t &phase, const std::uint32_t &step) {
+    return _mm256_add_epi32(_mm256_set1_epi32((int)phase),
+                            _mm256_mullo_epi32(_mm256_set1_epi32((int)step), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+}
+
+// sums[i] += scale * table(phase + i*step) + shift, returns how many samples it did
+TARGET_AVX2 int wavetableBlockAvx2(const float *table, const std::uint32_t &phase, const std::uint32_t &step,
+                                   const int &count, const float &scale, const float &shift, float *sums) {
+    __m256i phases = wavetablePhasesAvx2(phase, step);
+    const __m256i advance = _mm256_set1_epi32((int)(8 * step));
+    int sample{};
+    for (; sample + 8 <= count; sample += 8) {
+        const __m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(scale), readWavetableAvx2(table, phases)),
+                                           _mm256_set1_ps(shift));
+        _mm256_storeu_ps(sums + sample, _mm256_add_ps(_mm256_loadu_ps(sums + sample), value));
+        phases = _mm256_add_epi32(phases, advance);
+    }
+    return sample;
+}
+
+// Pulses, sums[i] += 2 * amplitude * (table(trailing) - table(phase) + duty) - 1
+TARGET_AVX2 int pulseBlockAvx2(const float *table, const std::uint32_t &phase, const std::uint32_t &trailing,
+                               const std::uint32_t &step, const int &count, const float &amplitude, const float &duty,
+                               float *sums) {
+    __m256i phases = wavetablePhasesAvx2(phase, step);
+    __m256i trailingPhases = wavetablePhasesAvx2(trailing, step);
+    const __m256i advance = _mm256_set1_epi32((int)(8 * step));
+    int sample{};
+    for (; sample + 8 <= count; sample += 8) {
+        const __m256 high = _mm256_add_ps(_mm256_sub_ps(readWavetableAvx2(table, trailingPhases),
+                                                        readWavetableAvx2(table, phases)), _mm256_set1_ps(duty));
+        const __m256 value = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(2.0f * amplitude), high), _mm256_set1_ps(1.0f));
+        _mm256_storeu_ps(sums + sample, _mm256_add_ps(_mm256_loadu_ps(sums + sample), value));
+        phases = _mm256_add_epi32(phases, advance);
+        trailingPhases = _mm256_add_epi32(trailingPhases, advance);
+    }
+    return sample;
+}
+#endif
+
+// Same structure and averaging as renderOscillatorBank, with a fixed point phase
+// accumulator per oscillator set from the exact phase at every block start. wavetableBank is
+// compileWavetableBank(bank, generator), compiled once however many ranges are rendered.
+std::vector<float> renderWavetableBank(const OscillatorBank &bank, const WavetableBank &wavetableBank,
+                                       const int &sampleCount, const Generator &generator, const int &firstSample,
+                                       const int &threadCount) {
+    std::vector<float> samples(sampleCount, 0.0f);
+    const std::size_t oscillatorCount = bank.size();
+    if (oscillatorCount == 0) {
+        return samples;
+    }
+    
+    const bool isSquare = generator == Generator::SquareWave;
+    const int blockCount = (sampleCount + g_oscillatorSeekInterval - 1) / g_oscillatorSeekInterval;
+    const int sliceCount = (int)((oscillatorCount + g_oscillatorSliceSize - 1) / g_oscillatorSliceSize);
+    std::vector<float> sums((std::size_t)sliceCount * sampleCount);
+    parallelFor(blockCount * sliceCount, threadCount, [&](const int &task) {
+        const int block = task / sliceCount;
+        const int slice = task % sliceCount;
+        const int blockStart = block * g_oscillatorSeekInterval;
+        const int blockLength = std::min(g_oscillatorSeekInterval, sampleCount - blockStart);
+        float *sliceSums = &sums[(std::size_t)slice * sampleCount + blockStart];
+        const std::size_t end = std::min(oscillatorCount, (slice + 1) * g_oscillatorSliceSize);
+        for (std::size_t i = slice * g_oscillatorSliceSize; i < end; ++i) {
+            const float amplitude = bank.amplitudes[i];
+            const float *table = wavetableBank.tables[i];
+            const std::uint32_t step = wavetablePhase((double)bank.frequencies[i] / g_samplingFrequency);
+            std::uint32_t phase = wavetablePhase(turnsAtSample(bank.frequencies[i], firstSample + blockStart, g_samplingFrequency)
+                                                 + wavetableBank.startTurns[i]);
+            const float duty = wavetableBank.duties[i];
+            if (isSquare && duty != 0.5f) {
+                // second accumulator trails the first by duty
+                std::uint32_t trailing = phase - wavetableBank.dutyPhases[i];
+                int done{};
+#if SIMD_X86
+                if (g_simdLevel == SimdLevel::Avx2) {
+                    done = pulseBlockAvx2(table, phase, trailing, step, blockLength, amplitude, duty, sliceSums);
+                    phase += (std::uint32_t)done * step;
+                    trailing += (std::uint32_t)done * step;
+                }
+#endif
+                for (int sample = done; sample < blockLength; ++sample) {
+                    const float high = readWavetable(table, trailing) - readWavetable(table, phase) + duty;
+                    sliceSums[sample] += 2.0f * amplitude * high - 1.0f;
+                    phase += step;
+                    trailing += step;
+                }
+            } else {
+                const float scale = 2.0f * amplitude;
+                const float shift = isSquare ? -1.0f : 2.0f * bank.offsets[i] / 255.0f - 1.0f;
+                int done{};
+#if SIMD_X86
+                if (g_simdLevel == SimdLevel::Avx2) {
+                    done = wavetableBlockAvx2(table, phase, step, blockLength, scale, shift, sliceSums);
+                    phase += (std::uint32_t)done * step;
+                }
+#endif
+                for (int sample = done; sample < blockLength; ++sample) {
+                    sliceSums[sample] += scale * readWavetable(table, phase) + shift;
+                    phase += step;
+                }
+            }
+        }
+    });
+    const double shift = foldedShift(bank, generator);
+    for (int sample{}; sample < sampleCount; ++sample) {
+        double sum = shift;
+        for (int slice{}; slice < sliceCount; ++slice) {
+            sum += sums[(std::size_t)slice * sampleCount + sample];
+        }
+        samples[sample] = (float)(sum / bank.pixelCount);
+    }
+    return samples;
+}
+
+int greatestCommonDivisor(int a, int b) {
+    while (b != 0) {
+        const int remainder = a % b;
+        a = b;
+        b = remainder;
+    }
+    return a;
+}
+
+// NOTE: Oscillators at whole Hz all repeat after samplingFrequency / gcd(f_i, samplingFrequency)
+//       samples, whatever their phase and offset. Returns 0 if a frequency is fractional.
+int detectPeriod(const OscillatorBank &bank, const int &samplingFrequency) {
+    int divisor = samplingFrequency;
+    for (const auto &frequency : bank.frequencies) {
+        if (frequency != std::floor(frequency)) {
+            return 0;
+        }
+        divisor = greatestCommonDivisor(divisor, (int)frequency);
+        if (divisor == 1) {
+            break;
+        }
+    }
+    return samplingFrequency / divisor;
+}
+
+void tilePeriod(std::vector<float> &samples, const std::size_t &sampleCount) {
+    const std::size_t period = samples.size();
+    samples.resize(sampleCount);
+    for (std::size_t sample = period; sample < sampleCount; ++sample) {
+        samples[sample] = samples[sample - period];
+    }
+}
+
+// Sine banks merge into columns for the column and fft engines, see ColumnBank
+bool canMergeColumns(const Generator &generator, const std::string &engine) {
+    return (engine == "column" || engine == "fft") && generator == Generator::SineWave;
+}
+
+bool usesWavetables(const Generator &generator, const std::string &engine) {
+    return engine == "wavetable" && generator != Generator::SineWave;
+}
+
+bool isEngineApplicable(const Generator &generator, const std::string &engine) {
+    return engine == "direct" || canMergeColumns(generator, engine) || usesWavetables(generator, engine);
+}
+
+// The engine a bank is actually rendered with and what that engine precomputes, shared by
+// renderBank and playBankWhileRendering. Direct stands in where the requested engine
+// doesn't apply, column where fft finds a frequency off its bins.
+struct PreparedBank {
+    std::string engine;
+    // samples [0, renderCount) are rendered, the rest repeats them
+    int renderCount;
+    ColumnBank columns;
+    WavetableBank wavetableBank;
+    // fft: one second of finished samples
+    std::vector<float> fftFrame;
+};
+
+PreparedBank prepareBank(const OscillatorBank &bank, const int &sampleCount, const Generator &generator,
+                         const std::string &engine) {
+    PreparedBank prepared;
+    const int period = detectPeriod(bank, g_samplingFrequency);
+    prepared.renderCount = (period > 0 && period < sampleCount) ? period : sampleCount;
+    if (g_doLog && prepared.renderCount < sampleCount) {
+        std::cout << "period: " << period << " samples" << std::endl;
+    }
+    prepared.engine = isEngineApplicable(generator, engine) ? engine : "direct";
+    if (g_doLog && prepared.engine != engine) {
+        std::cout << "Engine " << engine << " not applicable to " << generatorName(generator) << " here, using direct" << std::endl;
+    }
+    if (canMergeColumns(generator, prepared.engine)) {
+        prepared.columns = mergeColumns(bank);
+        if (g_doLog) {
+            std::cout << "column count: " << prepared.columns.frequencies.size() << std::endl;
+        }
+        if (prepared.engine == "fft" && !renderColumnBankFft(prepared.columns, prepared.fftFrame)) {
+            prepared.engine = "column";
+        }
+    }
+    if (usesWavetables(generator, prepared.engine)) {
+        prepared.wavetableBank = compileWavetableBank(bank, generator);
+    }
+    return prepared;
+}
+
+// Samples [firstSample, firstSample + sampleCount) with the prepared engine
+std::vector<float> renderBankRange(const OscillatorBank &bank, const PreparedBank &prepared, const int &firstSample,
+                                   const int &sampleCount, const Generator &generator, const int &threadCount) {
+    if (prepared.engine == "fft") {
+        std::vector<float> samples(sampleCount);
+        for (int sample{}; sample < sampleCount; ++sample) {
+            samples[sample] = prepared.fftFrame[(firstSample + sample) % prepared.fftFrame.size()];
+        }
+        return samples;
+    }
+    if (prepared.engine == "column") {
+        return renderColumnBank(prepared.columns, sampleCount, firstSample, threadCount);
+    }
+    if (prepared.engine == "wavetable") {
+        return renderWavetableBank(bank, prepared.wavetableBank, sampleCount, generator, firstSample, threadCount);
+    }
+    return renderOscillatorBank(bank, sampleCount, generator, firstSample, threadCount);
+}
+
+// Renders a single fundamental period with the requested engine and tiles it up to
+// sampleCount, so render cost does not grow with the duration.
+std::vector<float> renderBank(const OscillatorBank &bank, const int &sampleCount,
+                              const Generator &generator, const std::string &engine, const int &threadCount) {
+    const PreparedBank prepared = prepareBank(bank, sampleCount, generator, engine);
+    std::vector<float> samples = renderBankRange(bank, prepared, 0, prepared.renderCount, generator, threadCount);
+    tilePeriod(samples, sampleCount);
+    return samples;
+}
+
+// Collects the audible pixels of fileName into bank.
+// stripRows > 0 folds the image that many rows at a time instead of decoding all of it first.
+bool compileBitmap(const std::string &fileName, const int &stripRows, OscillatorBank &bank) {
+    if (g_doLog) {
+        std::cout << "Compile oscillator bank" << std::endl;
+    }
+    bool isDecoded = false;
+    if (stripRows > 0) {
+        isDecoded = streamOscillatorBank(fileName, stripRows, g_generator, bank);
+    } else {
+        Bitmap bitmap;
+        isDecoded = decodeBitmap(fileName, bitmap);
+        bank = compileOscillatorBank(bitmap);
+    }
+    if (!isDecoded) {
+        return false;
+    }
+    if (g_doLog) {
+        std::cout << "oscillator count: " << bank.size() << " for " << bank.pixelCount << " pixels" << std::endl;
+    }
+    return true;
+}
+
+// Compiles the audible pixels once, then renders sampleCount samples from them.
+bool renderBitmap(const std::string &fileName, const int &sampleCount, const int &stripRows,
+                  const int &threadCount, std::vector<float> &samples) {
+    OscillatorBank bank;
+    if (!compileBitmap(fileName, stripRows, bank)) {
+        return false;
+    }
     
-    g_device = alcOpenDevice(0);
-    g_context = alcCreateContext(g_device, 0);
-    alcMakeContextCurrent(g_context);
-    printAlcError(alcGetError(g_device), "alcOpenDevice");
+    if (g_doLog) {
+        std::cout << "Generate pcmData" << std::endl;
+    }
+    samples = renderBank(bank, sampleCount, g_generator, g_engine, threadCount);
+    return true;
+}
 
-    alGenBuffers(1, g_buffers);
-    printAlError(alGetError());
+// NOTE: One producer, one consumer. The mutex is only taken to park on a full or empty ring.
+struct BlockRing {
+    BlockRing(const std::size_t &blockSize, const std::size_t &blockCount)
+    : blockSize(blockSize), blockCount(blockCount), data(blockSize * blockCount), sizes(blockCount),
+      writeCount(0), readCount(0), isFinished(false), parkedCount(0) {}
     
-    alGenSources(1, g_sources);
-    printAlError(alGetError());
+    // Producer side, nullptr while the ring is full
+    ALubyte *writeBlock() {
+        const std::size_t written = writeCount.load(std::memory_order_relaxed);
+        if (written - readCount.load(std::memory_order_acquire) == blockCount) {
+            return nullptr;
+        }
+        return &data[(written % blockCount) * blockSize];
+    }
     
-    alSourcei(g_sources[0], AL_LOOPING, AL_TRUE);
-    printAlError(alGetError());
+    void commitBlock(const std::size_t &size) {
+        const std::size_t written = writeCount.load(std::memory_order_relaxed);
+        sizes[written % blockCount] = size;
+        writeCount.store(written + 1);
+        notify();
+    }
     
-    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    // After the last commitBlock, tells the consumer that an empty ring is the end
+    void finish() {
+        isFinished.store(true);
+        notify();
+    }
+    
+    void waitForSpace() {
+        park([this]() {
+            return writeCount.load(std::memory_order_relaxed) - readCount.load() < blockCount;
+        });
+    }
+    
+    // Consumer side, nullptr while the ring is empty
+    const ALubyte *readBlock(std::size_t &size) {
+        const std::size_t read = readCount.load(std::memory_order_relaxed);
+        if (read == writeCount.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        size = sizes[read % blockCount];
+        return &data[(read % blockCount) * blockSize];
+    }
+    
+    void releaseBlock() {
+        readCount.store(readCount.load(std::memory_order_relaxed) + 1);
+        notify();
+    }
+    
+    bool isDrained() const {
+        return isFinished.load(std::memory_order_acquire)
+            && readCount.load(std::memory_order_relaxed) == writeCount.load(std::memory_order_acquire);
+    }
+    
+    // Until there is a block to read or the producer is done
+    void waitForBlock() {
+        park([this]() {
+            return isFinished.load() || readCount.load(std::memory_order_relaxed) != writeCount.load();
+        });
+    }
+    
+    const std::size_t blockSize;
+    const std::size_t blockCount;
+    
+private:
+    std::vector<ALubyte> data;
+    std::vector<std::size_t> sizes;
+    std::atomic<std::size_t> writeCount;
+    std::atomic<std::size_t> readCount;
+    std::atomic<bool> isFinished;
+    std::atomic<int> parkedCount;
+    std::mutex mutex;
+    std::condition_variable moved;
+    
+    // The counter stores and parkedCount are sequentially consistent: either the parking
+    // side sees the new count in isReady, or notify sees it parked and wakes it.
+    template <typename IsReady>
+    void park(const IsReady &isReady) {
+        std::unique_lock<std::mutex> lock(mutex);
+        ++parkedCount;
+        moved.wait(lock, isReady);
+        --parkedCount;
+    }
+    
+    void notify() {
+        if (parkedCount.load() == 0) {
+            return;
+        }
+        { std::lock_guard<std::mutex> lock(mutex); }
+        moved.notify_one();
+    }
+};
+
+// A render block is g_threadCount seek intervals, so every thread gets one per block and
+// block boundaries fall where a full render seeks anyway, the blocks come out exactly like
+// the full render. 8 blocks are at least one second of lead at 8 kHz.
+const int g_renderBlockCount = 8;
+
+// NOTE: Waiting for the renderer only counts as an underrun once everything handed out would have been
+//       played by then.
+void playBankWhileRendering(const OscillatorBank &bank, const int &sampleCount, const int &milliseconds,
+                            std::vector<ALubyte> &pcmData) {
+    // prepared once here, not for every block
+    const PreparedBank prepared = prepareBank(bank, sampleCount, g_generator, g_engine);
+    const int renderCount = prepared.renderCount;
+    const int blockSamples = g_oscillatorSeekInterval * std::max(1, g_threadCount);
+    
+    const int sampleSize = bytesPerSample(g_sampleFormat);
+    const int totalCount = (int)((std::int64_t)g_samplingFrequency * milliseconds / 1000);
+    BlockRing ring((std::size_t)blockSamples * sampleSize, g_renderBlockCount);
+    const auto startTime = std::chrono::steady_clock::now();
+    
+    std::thread renderer([&]() {
+        std::vector<float> periodSamples;
+        std::vector<float> samples;
+        for (int first{}; first < totalCount; first += blockSamples) {
+            const int count = std::min(blockSamples, totalCount - first);
+            const int periodEnd = std::min(renderCount, first + count);
+            if ((int)periodSamples.size() < periodEnd) {
+                const std::vector<float> rendered = renderBankRange(bank, prepared, (int)periodSamples.size(),
+                    periodEnd - (int)periodSamples.size(), g_generator, g_threadCount);
+                periodSamples.insert(periodSamples.end(), rendered.begin(), rendered.end());
+            }
+            samples.resize(count);
+            for (int i{}; i < count; ++i) {
+                samples[i] = periodSamples[(first + i) % sampleCount % renderCount];
+            }
+            const std::vector<ALubyte> blockData = quantizeSamples(samples, g_sampleFormat);
+            
+            ALubyte *block = ring.writeBlock();
+            if (!block) {
+                ring.waitForSpace();
+                block = ring.writeBlock();
+            }
+            std::memcpy(block, blockData.data(), blockData.size());
+            ring.commitBlock(blockData.size());
+        }
+        ring.finish();
+    });
+    
+    pcmData.clear();
+    pcmData.reserve((std::size_t)sampleCount * sampleSize);
+    std::size_t blockOffset{};
+    std::uint64_t bytesPlayed{};
+    std::chrono::steady_clock::time_point firstBlockTime;
+    int underrunCount{};
+    bool isWaiting = false;
+    playStream(g_sampleFormat, [&](ALubyte *data, const int &capacity) {
+        int bytesWritten{};
+        while (bytesWritten < capacity) {
+            std::size_t blockSize{};
+            const ALubyte *block = ring.readBlock(blockSize);
+            if (!block) {
+                // hand over what is there rather than wait with it
+                if (bytesWritten > 0 || ring.isDrained()) {
+                    break;
+                }
+                if (!isWaiting && bytesPlayed > 0) {
+                    const auto audioTime = std::chrono::milliseconds(bytesPlayed / sampleSize * 1000 / g_samplingFrequency);
+                    underrunCount += std::chrono::steady_clock::now() - firstBlockTime >= audioTime ? 1 : 0;
+                }
+                isWaiting = true;
+                ring.waitForBlock();
+                continue;
+            }
+            if (bytesPlayed == 0) {
+                firstBlockTime = std::chrono::steady_clock::now();
+                std::cout << "first block after "
+                          << std::chrono::duration_cast<std::chrono::milliseconds>(firstBlockTime - startTime).count() << " ms" << std::endl;
+            }
+            isWaiting = false;
+            const std::size_t count = std::min((std::size_t)(capacity - bytesWritten), blockSize - blockOffset);
+            std::memcpy(data + bytesWritten, block + blockOffset, count);
+            const std::size_t cacheCount = std::min(count, pcmData.capacity() - pcmData.size());
+            pcmData.insert(pcmData.end(), block + blockOffset, block + blockOffset + cacheCount);
+            bytesWritten += (int)count;
+            bytesPlayed += count;
+            blockOffset += count;
+            if (blockOffset == blockSize) {
+                ring.releaseBlock();
+                blockOffset = 0;
+            }
+        }
+        return bytesWritten;
+    });
+    renderer.join();
+    if (underrunCount > 0) {
+        std::cout << "render underruns: " << underrunCount << std::endl;
+    }
 }
 
-void tearDownOpenAl() {
-    printAlcError(alcGetError(g_device), "alcCloseDevice_pre");
+// NOTE: x is time and y is frequency. Amplitudes crossfade over g_scanCrossfadeMilliseconds so column
+//       changes don't click.
+const int g_scanColumnMilliseconds = 10;
+const int g_scanCrossfadeMilliseconds = 5;
+const float g_scanLowestFrequency = 100.0f;
+const float g_scanHighestFrequency = 0.475f * g_samplingFrequency;
+
+float scanlineFrequency(const int &y, const int &height) {
+    if (height == 1) {
+        return g_scanLowestFrequency;
+    }
+    return g_scanLowestFrequency + (g_scanHighestFrequency - g_scanLowestFrequency) * (height - 1 - y) / (height - 1);
+}
+
+// Unlike the *WaveValue functions these are centered on 0, many rows get summed
+float scanlineValue(const Generator &generator, const Oscillator &oscillator) {
+    switch (generator) {
+        case Generator::SquareWave:
+            return oscillator.sine < 0.0 ? -1.0f : 1.0f;
+        case Generator::SawtoothWave:
+            return (float)(2.0 * (oscillator.cycle - std::floor(0.5 + oscillator.cycle)));
+        default:
+            return (float)oscillator.sine;
+    }
+}
+
+struct ScanlineRenderer {
+    ScanlineRenderer(const Bitmap &bitmap, const int &columnSamples, const Generator &generator)
+    : bitmap(bitmap),
+      columnSamples(columnSamples),
+      fadeSamples(std::max(1, std::min(columnSamples, g_samplingFrequency * g_scanCrossfadeMilliseconds / 1000))),
+      generator(generator),
+      column(0),
+      gain(0.0f),
+      previous(bitmap.height, 0.0f),
+      current(bitmap.height, 0.0f)
+    {
+        oscillators.reserve(bitmap.height);
+        for (int y{}; y < bitmap.height; ++y) {
+            oscillators.emplace_back(scanlineFrequency(y, bitmap.height), 0.0f, g_samplingFrequency);
+        }
+        
+        // The loudest column sets the gain, the sum of its amplitudes can't clip
+        std::vector<float> columnSums(bitmap.width, 0.0f);
+        for (int y{}; y < bitmap.height; ++y) {
+            for (int x{}; x < bitmap.width; ++x) {
+                columnSums[x] += amplitude(x, y);
+            }
+        }
+        const float loudest = columnSums.empty() ? 0.0f : *std::max_element(columnSums.begin(), columnSums.end());
+        gain = loudest > 0.0f ? 1.0f / loudest : 0.0f;
+    }
     
-    ALCboolean closeSucceeded = alcCloseDevice(g_device);
-    if (!closeSucceeded) {
-        std::cout << "closing device failed";
+    float amplitude(const int &x, const int &y) const {
+        const std::size_t pixel = (std::size_t)y*bitmap.width + x;
+        float value;
+        return pixelAmplitude(bitmap.r[pixel], bitmap.g[pixel], bitmap.b[pixel], value) ? value : 0.0f;
+    }
+    
+    // The next column into samples, then a short fade to silence, false after that
+    bool renderColumn(std::vector<float> &samples) {
+        if (column > bitmap.width) {
+            return false;
+        }
+        const bool isFadeOut = column == bitmap.width;
+        const int count = isFadeOut ? fadeSamples : columnSamples;
+        const int firstSample = column * columnSamples;
+        samples.assign(count, 0.0f);
+        for (int y{}; y < bitmap.height; ++y) {
+            current[y] = isFadeOut ? 0.0f : amplitude(column, y);
+            if (previous[y] == 0.0f && current[y] == 0.0f) {
+                continue;
+            }
+            Oscillator &oscillator = oscillators[y];
+            oscillator.seek(firstSample);
+            const float step = (current[y] - previous[y]) / fadeSamples;
+            for (int sample{}; sample < count; ++sample) {
+                const float level = sample < fadeSamples ? previous[y] + step * (sample + 1) : current[y];
+                samples[sample] += level * scanlineValue(generator, oscillator);
+                oscillator.advance();
+            }
+        }
+        for (auto &sample : samples) {
+            sample *= gain;
+        }
+        std::swap(previous, current);
+        ++column;
+        return true;
+    }
+    
+    const Bitmap &bitmap;
+    const int columnSamples;
+    const int fadeSamples;
+    const Generator generator;
+    int column;
+    float gain;
+    std::vector<Oscillator> oscillators;
+    // row amplitudes of the column before and of this one
+    std::vector<float> previous;
+    std::vector<float> current;
+};
+
+void playScanline(const Bitmap &bitmap, const int &columnMilliseconds) {
+    const int columnSamples = std::max(1, g_samplingFrequency * columnMilliseconds / 1000);
+    ScanlineRenderer renderer(bitmap, columnSamples, g_generator);
+    std::cout << "scanline: " << bitmap.width << " columns of " << columnSamples << " samples, "
+              << bitmap.height << " rows from " << g_scanLowestFrequency << " to " << g_scanHighestFrequency << " Hz" << std::endl;
+    
+    std::vector<float> column;
+    std::size_t columnOffset{};
+    std::vector<float> samples;
+    std::chrono::steady_clock::duration renderTime{};
+    std::uint64_t samplesRendered{};
+    const int sampleSize = bytesPerSample(g_sampleFormat);
+    playStream(g_sampleFormat, [&](ALubyte *data, const int &capacity) {
+        const auto startTime = std::chrono::steady_clock::now();
+        samples.clear();
+        while ((int)samples.size() < capacity / sampleSize) {
+            if (columnOffset == column.size()) {
+                if (!renderer.renderColumn(column)) {
+                    break;
+                }
+                columnOffset = 0;
+            }
+            const std::size_t count = std::min(column.size() - columnOffset, capacity / sampleSize - samples.size());
+            samples.insert(samples.end(), column.begin() + columnOffset, column.begin() + columnOffset + count);
+            columnOffset += count;
+        }
+        const std::vector<ALubyte> pcmData = quantizeSamples(samples, g_sampleFormat);
+        std::memcpy(data, pcmData.data(), pcmData.size());
+        renderTime += std::chrono::steady_clock::now() - startTime;
+        samplesRendered += samples.size();
+        return (int)pcmData.size();
+    });
+    
+    const double audioMilliseconds = samplesRendered * 1000.0 / g_samplingFrequency;
+    const double renderMilliseconds = std::chrono::duration_cast<std::chrono::microseconds>(renderTime).count() / 1000.0;
+    std::cout << "scanline: " << audioMilliseconds << " ms of audio rendered in " << renderMilliseconds << " ms" << std::endl;
+}
+
+// Loud passages are scaled down as a whole rather than clipped
+void normalizePeak(std::vector<float> &samples) {
+    float peak{};
+    for (const float &sample : samples) {
+        peak = std::max(peak, std::fabs(sample));
+    }
+    if (peak > 1.0f) {
+        for (float &sample : samples) {
+            sample /= peak;
+        }
     }
 }
 
-void playAlleMeineEntchen() {
-    std::vector<Note> alleMeineEntchen = {
-        Note('c', 8), Note('d', 8), Note('e', 8), Note('f', 8), Note('g', 4), Note('g', 4),
-        Note('a', 8), Note('a', 8), Note('a', 8), Note('a', 8), Note('g', 2),
-        Note('a', 8), Note('a', 8), Note('a', 8), Note('a', 8), Note('g', 2),
-        Note('f', 8), Note('f', 8), Note('f', 8), Note('f', 8), Note('e', 4), Note('e', 4),
-        Note('g', 8), Note('g', 8), Note('g', 8), Note('g', 8), Note('c', 2)
-    };
-    playNotes(alleMeineEntchen);
+// Streams samples that are already rendered and quantized, back to back
+void playPcm(const std::vector<ALubyte> &pcmData) {
+    std::size_t offset{};
+    playStream(g_sampleFormat, [&](ALubyte *data, const int &capacity) {
+        const std::size_t count = std::min((std::size_t)capacity, pcmData.size() - offset);
+        std::memcpy(data, pcmData.data() + offset, count);
+        offset += count;
+        return (int)count;
+    });
+}
+
+// NOTE: Slices don't share samples, so the mix is the same for any thread count.
+const int g_mixSliceSamples = 16 * g_oscillatorSeekInterval;
+
+// At least minimumSampleCount samples long, longer if notes sound past that
+std::vector<float> mixTimeline(std::vector<NoteEvent> events, const int &minimumSampleCount, const int &threadCount,
+                               int &stolenCount) {
+    stolenCount = limitPolyphony(events);
+    const int sampleCount = std::max(minimumSampleCount, timelineEnd(events));
+    std::vector<float> samples(sampleCount);
+    const int sliceCount = (sampleCount + g_mixSliceSamples - 1) / g_mixSliceSamples;
+    std::vector<std::vector<std::size_t>> sliceEvents(sliceCount);
+    for (std::size_t i{}; i < events.size(); ++i) {
+        const int endSample = std::min(sampleCount, events[i].startSample + events[i].sampleCount);
+        for (int slice = events[i].startSample / g_mixSliceSamples; slice * g_mixSliceSamples < endSample; ++slice) {
+            sliceEvents[slice].push_back(i);
+        }
+    }
+    parallelFor(sliceCount, threadCount, [&](const int &slice) {
+        const int sliceStart = slice * g_mixSliceSamples;
+        const int sliceEnd = std::min(sampleCount, sliceStart + g_mixSliceSamples);
+        for (const std::size_t &index : sliceEvents[slice]) {
+            const NoteEvent &note = events[index];
+            const int first = std::max(sliceStart, note.startSample);
+            const int last = std::min(sliceEnd, note.startSample + note.sampleCount);
+            mixNote(samples.data() + first, first - note.startSample, last - first, note);
+        }
+    });
+    return samples;
+}
+
+// Renders the whole file offline, then streams it
+bool playMidiFile(const std::string &fileName) {
+    std::vector<NoteEvent> events;
+    if (!loadMidiFile(fileName, events)) {
+        return false;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    int stolenCount{};
+    std::vector<float> samples = mixTimeline(events, 0, g_threadCount, stolenCount);
+    normalizePeak(samples);
+    const std::vector<ALubyte> pcmData = quantizeSamples(samples, g_sampleFormat);
+    const double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    const double audioMs = samples.size() * 1000.0 / g_samplingFrequency;
+    std::cout << "rendered " << audioMs << " ms in " << renderMs << " ms (" << audioMs / renderMs << "x real time)";
+    if (stolenCount > 0) {
+        std::cout << ", " << stolenCount << " voices stolen";
+    }
+    std::cout << std::endl;
+    playPcm(pcmData);
+    return true;
+}
+
+bool playScoreFile(const std::string &fileName) {
+    std::vector<Note> notes;
+    if (!loadScore(fileName, notes)) {
+        return false;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<NoteEvent> events = noteTimeline(notes);
+    // a score can end on a rest
+    int restEnd{};
+    for (std::size_t i{}; i < notes.size(); ++i) {
+        if (i == 0 || !notes[i].isChordTone) {
+            restEnd += g_samplingFrequency / notes[i].durationDivisor;
+        }
+    }
+    int stolenCount{};
+    std::vector<float> samples = mixTimeline(events, restEnd, g_threadCount, stolenCount);
+    normalizePeak(samples);
+    const std::vector<ALubyte> pcmData = quantizeSamples(samples, g_sampleFormat);
+    const double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << fileName << ": " << notes.size() << " notes, " << samples.size() * 1000.0 / g_samplingFrequency
+              << " ms rendered in " << renderMs << " ms on " << g_threadCount << " threads";
+    if (stolenCount > 0) {
+        std::cout << ", " << stolenCount << " voices stolen";
+    }
+    std::cout << std::endl;
+    playPcm(pcmData);
+    return true;
 }
 
-struct RGB {
-    std::uint8_t r;
-    std::uint8_t g;
-    std::uint8_t b;
+// NOTE: Bump g_pcmCacheVersion whenever a change to the synthesis changes what gets rendered.
+const std::uint32_t g_pcmCacheVersion = 3;
+const std::size_t g_pcmCacheHeaderSize = 64;
+
+struct PcmCacheHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t key;
+    std::uint32_t samplingFrequency;
+    std::uint32_t sampleFormat;
+    std::uint64_t sampleCount;
+    std::uint64_t dataOffset;
 };
 
+// false if the image can't be read, nothing can be cached for it then
+bool pcmCacheKey(const std::string &fileName, const int &sampleCount, const bool &isStreamed, std::uint64_t &key) {
+    const MappedFile file(fileName);
+    if (!file.data) {
+        return false;
+    }
+    key = hashBytes(file.data, file.size);
+    // the SIMD kernels round some samples differently from the scalar ones
+    const std::string settings = generatorName(g_generator) + "/" + g_engine + "/" + simdLevelName(g_simdLevel)
+        + "/" + std::to_string(g_samplingFrequency) + "/" + std::to_string(sampleCount) + "/" + std::to_string((int)g_sampleFormat)
+        + "/" + std::to_string(isStreamed) + "/" + std::to_string(g_pcmCacheVersion);
+    key = hashBytes(settings.data(), settings.size(), key);
+    return true;
+}
+
+std::string pcmCachePath(const std::uint64_t &key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.pcm", (unsigned long long)key);
+    return g_cacheDirectory + "/" + name;
+}
+
+// Marks an entry as just used
+void touchPcmCacheFile(const std::string &path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                              OPEN_EXISTING, 0, nullptr);
+    if (file != INVALID_HANDLE_VALUE) {
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        SetFileTime(file, nullptr, nullptr, &now);
+        CloseHandle(file);
+    }
+#else
+    utime(path.c_str(), nullptr);
+#endif
+}
+
+// Deletes least recently used entries until the cache fits in g_cacheByteLimit
+void evictPcmCache() {
+    std::vector<FileInfo> entries = listFiles(g_cacheDirectory, ".pcm");
+    std::uint64_t totalSize{};
+    for (const auto &entry : entries) {
+        totalSize += entry.size;
+    }
+    std::sort(entries.begin(), entries.end(), [](const FileInfo &a, const FileInfo &b) {
+        return a.lastModified < b.lastModified;
+    });
+    for (std::size_t i{}; i < entries.size() && totalSize > g_cacheByteLimit; ++i) {
+        if (std::remove(entries[i].path.c_str()) == 0) {
+            totalSize -= entries[i].size;
+            std::cout << "cache evicted " << entries[i].path << std::endl;
+        }
+    }
+}
+
+// Plays the cached rendering for key straight from the mapping, false on a miss
+// Streams the cached samples tiled up to milliseconds, the same bytes playBankWhileRendering
+// hands out on a miss
+bool playCachedPcm(const std::uint64_t &key, const int &sampleCount, const int &milliseconds) {
+    const std::string path = pcmCachePath(key);
+    const MappedFile file(path);
+    if (!file.data || file.size < g_pcmCacheHeaderSize) {
+        return false;
+    }
+    PcmCacheHeader header;
+    std::memcpy(&header, file.data, sizeof(header));
+    const std::uint64_t dataSize = (std::uint64_t)sampleCount * bytesPerSample(g_sampleFormat);
+    if (std::memcmp(header.magic, "DYNP", 4) != 0 || header.version != g_pcmCacheVersion || header.key != key
+        || header.samplingFrequency != (std::uint32_t)g_samplingFrequency
+        || header.sampleFormat != (std::uint32_t)g_sampleFormat || header.sampleCount != (std::uint64_t)sampleCount
+        || header.dataOffset < g_pcmCacheHeaderSize || header.dataOffset + dataSize > file.size) {
+        std::cout << "cache entry " << path << " is damaged, rendering again" << std::endl;
+        return false;
+    }
+    touchPcmCacheFile(path);
+    std::cout << "Play pcmData from cache " << path << std::endl;
+    const int sampleSize = bytesPerSample(g_sampleFormat);
+    const ALubyte *cachedData = file.data + header.dataOffset;
+    const std::uint64_t totalSize = (std::uint64_t)((std::int64_t)g_samplingFrequency * milliseconds / 1000) * sampleSize;
+    std::uint64_t offset{};
+    playStream(g_sampleFormat, [&](ALubyte *data, const int &capacity) {
+        int bytesWritten{};
+        while (bytesWritten < capacity && offset < totalSize) {
+            const std::uint64_t position = offset % dataSize;
+            const std::size_t count = (std::size_t)std::min(std::min((std::uint64_t)(capacity - bytesWritten), dataSize - position),
+                                                            totalSize - offset);
+            std::memcpy(data + bytesWritten, cachedData + position, count);
+            bytesWritten += (int)count;
+            offset += count;
+        }
+        return bytesWritten;
+    });
+    return true;
+}
+
+// Written to a temporary name and renamed, so a reader never maps a half written file
+void storeCachedPcm(const std::uint64_t &key, const std::vector<ALubyte> &pcmData, const int &sampleCount) {
+    makeDirectory(g_cacheDirectory);
+    PcmCacheHeader header{};
+    std::memcpy(header.magic, "DYNP", 4);
+    header.version = g_pcmCacheVersion;
+    header.key = key;
+    header.samplingFrequency = g_samplingFrequency;
+    header.sampleFormat = (std::uint32_t)g_sampleFormat;
+    header.sampleCount = sampleCount;
+    header.dataOffset = g_pcmCacheHeaderSize;
+    char headerBytes[g_pcmCacheHeaderSize] = {};
+    std::memcpy(headerBytes, &header, sizeof(header));
+    
+    const std::string path = pcmCachePath(key);
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream cacheFile(temporaryPath, std::ios::binary);
+        cacheFile.write(headerBytes, sizeof(headerBytes));
+        cacheFile.write((const char *)pcmData.data(), pcmData.size());
+        if (!cacheFile) {
+            std::cout << "Could not write " << temporaryPath << std::endl;
+            cacheFile.close();
+            std::remove(temporaryPath.c_str());
+            return;
+        }
+    }
+    std::remove(path.c_str()); // rename does not replace on Windows
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+        return;
+    }
+    evictPcmCache();
+}
+
+void MemorySink::finish() {
+    std::cout << "Captured " << sampleCount() << " samples, FNV-1a " << std::hex << hashBytes(data.data(), data.size())
+              << std::dec << std::endl;
+}
+
+// NOTE: An image bigger than one thread's share of the batch gets all threads to itself, so it can't end
+//       up as the last job keeping one core busy.
+bool renderBatch(const std::vector<std::string> &inputs, const std::string &outputDirectory) {
+    std::vector<FileInfo> images;
+    bool isComplete = true;
+    for (const auto &input : inputs) {
+        FileInfo info;
+        if (!statFile(input, info)) {
+            std::cout << "Could not open " << input << std::endl;
+            isComplete = false;
+        } else if (info.isDirectory) {
+            const std::vector<FileInfo> found = listFiles(input, ".bmp");
+            images.insert(images.end(), found.begin(), found.end());
+        } else {
+            images.push_back(info);
+        }
+    }
+    
+    // <outputDirectory>/<image name>.wav, an image named twice is only rendered once and two
+    // images with the same name from different directories are refused rather than overwritten
+    std::vector<std::string> outputPaths;
+    std::map<std::string, std::string> pathByOutput;
+    for (std::size_t i{}; i < images.size();) {
+        const std::string &path = images[i].path;
+        const std::size_t nameStart = path.find_last_of("/\\") + 1; // npos + 1 == 0
+        const std::string name = path.substr(nameStart, path.rfind('.') > nameStart ? path.rfind('.') - nameStart : std::string::npos);
+        const std::string outputPath = outputDirectory + "/" + name + ".wav";
+        // case insensitive file systems would still clash
+        std::string outputKey = outputPath;
+        std::transform(outputKey.begin(), outputKey.end(), outputKey.begin(), [](const char &c) { return (char)std::tolower((unsigned char)c); });
+        const auto clash = pathByOutput.find(outputKey);
+        if (clash == pathByOutput.end()) {
+            pathByOutput[outputKey] = path;
+            outputPaths.push_back(outputPath);
+            ++i;
+            continue;
+        }
+        if (clash->second != path) {
+            std::cout << path << " and " << clash->second << " would both be written to " << outputPath << std::endl;
+            isComplete = false;
+        }
+        images.erase(images.begin() + i);
+    }
+    if (!isComplete) {
+        return false;
+    }
+    makeDirectory(outputDirectory);
+    
+    // The per image chatter of decoder and engines would interleave between threads, only
+    // one line per image goes out, whole
+    const bool doLog = g_doLog;
+    g_doLog = false;
+    std::mutex reportMutex;
+    
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::pair<std::size_t, int>> costs(images.size()); // (pixels, image)
+    for (std::size_t i{}; i < images.size(); ++i) {
+        const MappedFile file(images[i].path);
+        BitmapHeader header;
+        costs[i].first = readBitmapHeader(file, images[i].path, header) ? (std::size_t)header.width * header.height : 0;
+        costs[i].second = (int)i;
+    }
+    std::sort(costs.begin(), costs.end(), std::greater<std::pair<std::size_t, int>>());
+    std::size_t totalCost{};
+    for (const auto &cost : costs) {
+        totalCost += cost.first;
+    }
+    std::size_t largeCount{};
+    while (largeCount < costs.size() && g_threadCount > 1 && costs[largeCount].first * g_threadCount > totalCost) {
+        ++largeCount;
+    }
+    
+    const int sampleCount = g_samplingFrequency * 2;
+    std::atomic<int> failedCount(0);
+    auto renderImage = [&](const int &index, const int &threadCount) {
+        const std::string &path = images[costs[index].second].path;
+        const std::string &outputPath = outputPaths[costs[index].second];
+        
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<float> samples;
+        // no cost means the header was refused already
+        bool isRendered = costs[index].first > 0 && renderBitmap(path, sampleCount, 0, threadCount, samples);
+        if (isRendered) {
+            const std::vector<ALubyte> pcmData = quantizeSamples(samples, g_sampleFormat);
+            FileSink sink(outputPath, g_sampleFormat);
+            sink.beginStream(g_sampleFormat);
+            sink.writeStream(pcmData.data(), pcmData.size());
+            sink.endStream();
+            isRendered = sink.close();
+        }
+        const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::lock_guard<std::mutex> lock(reportMutex);
+        if (isRendered) {
+            std::cout << path << " -> " << outputPath << " in " << milliseconds << " ms" << std::endl;
+        } else {
+            ++failedCount;
+            std::cout << path << " failed" << std::endl;
+        }
+    };
+    
+    // large images get every thread each, the rest one thread per image
+    for (std::size_t i{}; i < largeCount; ++i) {
+        renderImage((int)i, g_threadCount);
+    }
+    parallelFor((int)(images.size() - largeCount), g_threadCount, [&](const int &index) {
+        renderImage((int)largeCount + index, 1);
+    });
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    g_doLog = doLog;
+    const std::size_t renderedCount = images.size() - failedCount;
+    std::cout << "batch: " << renderedCount << " of " << images.size() << " images on " << g_threadCount
+              << " threads in " << seconds << " s, " << renderedCount / seconds << " images/s, "
+              << renderedCount * (double)sampleCount / seconds << " samples/s" << std::endl;
+    return isComplete && failedCount == 0;
+}
+
+// Times computeSampleValueSineWave against stepping Oscillators over the same bank, then
+// measures how far each drifts from an exact long double reference over one hour.
+void benchmarkOscillators() {
+    const int oscillatorCount = 1000;
+    const int sampleCount = g_samplingFrequency * 10;
+    
+    double directChecksum{};
+    auto start = std::chrono::steady_clock::now();
+    for (int sample{}; sample < sampleCount; ++sample) {
+        for (int i{}; i < oscillatorCount; ++i) {
+            directChecksum += computeSampleValueSineWave(sample, g_samplingFrequency, 1.0f, i + 0.5f, 0.0f, 0.0f);
+        }
+    }
+    const double directMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    
+    double oscillatorChecksum{};
+    start = std::chrono::steady_clock::now();
+    for (int i{}; i < oscillatorCount; ++i) {
+        Oscillator oscillator(i + 0.5f, 0.0f, g_samplingFrequency);
+        for (int sample{}; sample < sampleCount; ++sample) {
+            if (sample % g_oscillatorSeekInterval == 0) {
+                oscillator.seek(sample);
+            }
+            oscillatorChecksum += sineWaveValue(1.0f, oscillator.sine, 0.0f);
+            oscillator.advance();
+        }
+    }
+    const double oscillatorMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    
+    std::cout << "oscillators x samples: " << oscillatorCount << " x " << sampleCount << std::endl;
+    std::cout << "  computeSampleValueSineWave: " << directMs << " ms (checksum " << directChecksum << ")" << std::endl;
+    std::cout << "          Oscillator stepping: " << oscillatorMs << " ms (checksum " << oscillatorChecksum << ")" << std::endl;
+    std::cout << "                      speedup: " << directMs / oscillatorMs << "x" << std::endl;
+    
+    const float frequency = 440.5f;
+    const int driftSampleCount = g_samplingFrequency * 3600;
+    Oscillator seeking(frequency, 0.0f, g_samplingFrequency);
+    Oscillator rotating(frequency, 0.0f, g_samplingFrequency);
+    double floatTimeDrift{};
+    double seekingDrift{};
+    double rotatingDrift{};
+    for (int sample{}; sample < driftSampleCount; ++sample) {
+        const long double turns = std::fmod((long double)frequency * sample, (long double)g_samplingFrequency) / g_samplingFrequency;
+        const long double exact = std::sin(2.0L*M_PI*turns);
+        const float t = (float)sample / (float)g_samplingFrequency;
+        if (sample % g_oscillatorSeekInterval == 0) {
+            seeking.seek(sample);
+        }
+        floatTimeDrift = std::max(floatTimeDrift, (double)std::fabs(std::sin(2.0f*M_PI*frequency*t) - exact));
+        seekingDrift = std::max(seekingDrift, (double)std::fabs(seeking.sine - exact));
+        rotatingDrift = std::max(rotatingDrift, (double)std::fabs(rotating.sine - exact));
+        seeking.advance();
+        rotating.advance();
+    }
+    std::cout << "max |error| of sin(" << frequency << " Hz) over " << driftSampleCount / g_samplingFrequency << " s:" << std::endl;
+    std::cout << "                 float t: " << floatTimeDrift << std::endl;
+    std::cout << "  Oscillator, seek every " << g_oscillatorSeekInterval << ": " << seekingDrift << std::endl;
+    std::cout << "    Oscillator, never seek: " << rotatingDrift << std::endl;
+}
+
+// Voices against the clock: a note starting every voiceCount-th of a second keeps that many
+// voices sounding at once, past g_voiceCount the oldest ones get stolen.
+void benchmarkVoices() {
+    const int seconds = 20;
+    const int blockSize = 256;
+    std::vector<float> block(blockSize);
+    for (const int voiceCount : {16, 64, 96, g_voiceCount, 2 * g_voiceCount}) {
+        std::vector<NoteEvent> events;
+        for (int i{}; i < voiceCount * seconds; ++i) {
+            const float frequency = 110.0f + (i % voiceCount) * 3000.0f / voiceCount;
+            events.push_back(NoteEvent{(int)((std::int64_t)i * g_samplingFrequency / voiceCount), g_samplingFrequency,
+                                       frequency, 1.0f / voiceCount, g_generator});
+        }
+        TimelineRenderer renderer(events);
+        double checksum{};
+        std::int64_t sampleCount{};
+        const auto start = std::chrono::steady_clock::now();
+        for (int count = renderer.render(block.data(), blockSize); count > 0; count = renderer.render(block.data(), blockSize)) {
+            for (int i{}; i < count; ++i) {
+                checksum += block[i];
+            }
+            sampleCount += count;
+        }
+        const double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        const double audioMs = sampleCount * 1000.0 / g_samplingFrequency;
+        std::cout << voiceCount << " voices: peak " << renderer.voices.peakActiveCount << ", stolen "
+                  << renderer.voices.stolenCount << ", " << audioMs << " ms in " << renderMs << " ms ("
+                  << audioMs / renderMs << "x real time, checksum " << checksum << ")" << std::endl;
+    }
+}
+
 int main(int argc, char* argv[]) {
     // STUDY(mja): replace this epicness with proper command line parser
     std::map<std::string, std::string> commandLineOptions;
+    // every value after a key, for options that take a list like -batch data/*.bmp
+    std::map<std::string, std::vector<std::string>> commandLineLists;
     std::string currentKey;
     for (int i = 0; i < argc; ++i) {
         std::string value = argv[i];
@@ -274,14 +4034,96 @@ int main(int argc, char* argv[]) {
             commandLineOptions[currentKey] = "";
         } else {
             commandLineOptions[currentKey] = value;
+            commandLineLists[currentKey].push_back(value);
         }
     }
     
     if (commandLineOptions.find("-generator") != commandLineOptions.end()) {
-        g_generator = commandLineOptions["-generator"];
+        g_generator = parseGenerator(commandLineOptions["-generator"]);
+    }
+    
+    g_threadCount = std::max(1u, std::thread::hardware_concurrency());
+    if (commandLineOptions.find("-threads") != commandLineOptions.end()) {
+        g_threadCount = std::max(1, std::atoi(commandLineOptions["-threads"].c_str()));
+    }
+    
+    if (commandLineOptions.find("-engine") != commandLineOptions.end()) {
+        g_engine = commandLineOptions["-engine"];
+    }
+    
+    // -simd can only lower the detected level, never raise it
+    g_simdLevel = detectSimdLevel();
+    if (commandLineOptions.find("-simd") != commandLineOptions.end()) {
+        const std::string simd = commandLineOptions["-simd"];
+        if (simd == "scalar") {
+            g_simdLevel = SimdLevel::Scalar;
+        } else if (simd == "sse41" && g_simdLevel == SimdLevel::Avx2) {
+            g_simdLevel = SimdLevel::Sse41;
+        }
+    }
+    std::cout << "simd: " << simdLevelName(g_simdLevel) << std::endl;
+    
+    if (commandLineOptions.find("-benchmarkOscillators") != commandLineOptions.end()) {
+        benchmarkOscillators();
+        return 0;
+    }
+    
+    if (commandLineOptions.find("-benchmarkVoices") != commandLineOptions.end()) {
+        benchmarkVoices();
+        return 0;
     }
     
-    setupOpenAlDeviceWithOneSourceAndOneBuffer();
+    if (commandLineOptions.find("-checkBuiltins") != commandLineOptions.end()) {
+        return checkBuiltinSongs() ? 0 : 1;
+    }
+    
+    if (commandLineOptions.find("-sampleFormat") != commandLineOptions.end()) {
+        g_sampleFormat = parseSampleFormat(commandLineOptions["-sampleFormat"]);
+    }
+    
+    // -cacheMegabytes 0 turns the cache of rendered bitmaps off
+    if (commandLineOptions.find("-cacheDir") != commandLineOptions.end()) {
+        g_cacheDirectory = commandLineOptions["-cacheDir"];
+    }
+    if (commandLineOptions.find("-cacheMegabytes") != commandLineOptions.end()) {
+        g_cacheByteLimit = (std::uint64_t)std::max(0, std::atoi(commandLineOptions["-cacheMegabytes"].c_str())) << 20;
+    }
+    // what the sound card may keep of played notes and bitmaps for the next time
+    if (commandLineOptions.find("-alBufferMegabytes") != commandLineOptions.end()) {
+        g_alBufferByteLimit = (std::uint64_t)std::max(0, std::atoi(commandLineOptions["-alBufferMegabytes"].c_str())) << 20;
+    }
+    
+    if (commandLineOptions.find("-batch") != commandLineOptions.end()) {
+        const std::string outputDirectory = commandLineOptions.find("-batchOut") != commandLineOptions.end()
+                                          ? commandLineOptions["-batchOut"] : "batch";
+        return renderBatch(commandLineLists["-batch"], outputDirectory) ? 0 : 1;
+    }
+    
+    // Where the sound goes: -renderTo out.wav (or raw samples for other names) and
+    // -sink null|memory never open an audio device and run as fast as synthesis does
+    std::unique_ptr<AudioSink> sink;
+    const std::string sinkName = commandLineOptions.find("-sink") != commandLineOptions.end()
+                               ? commandLineOptions["-sink"] : "openal";
+    if (commandLineOptions.find("-renderTo") != commandLineOptions.end()) {
+        FileSink *fileSink = new FileSink(commandLineOptions["-renderTo"], g_sampleFormat);
+        sink.reset(fileSink);
+        if (!fileSink->isOpen()) {
+            std::cout << "Could not open " << commandLineOptions["-renderTo"] << std::endl;
+            return 1;
+        }
+    } else if (sinkName == "null") {
+        sink.reset(new NullSink(g_sampleFormat));
+    } else if (sinkName == "memory") {
+        sink.reset(new MemorySink(g_sampleFormat));
+    } else {
+        sink.reset(new OpenAlSink());
+        
+        if (g_sampleFormat == SampleFormat::Float32 && !alIsExtensionPresent("AL_EXT_float32")) {
+            std::cout << "AL_EXT_float32 not available, using s16" << std::endl;
+            g_sampleFormat = SampleFormat::Signed16;
+        }
+    }
+    g_sink = sink.get();
     
     if (commandLineOptions.find("-alleMeineEntchen") != commandLineOptions.end()) {
         playAlleMeineEntchen();
@@ -289,137 +4131,70 @@ int main(int argc, char* argv[]) {
     
     if (commandLineOptions.find("-playFile") != commandLineOptions.end()) {
         auto fileName = commandLineOptions["-playFile"];
-        std::ifstream testFile(fileName, std::ios::binary|std::ios::ate);
-        auto bytesCount = testFile.tellg();
-        auto fileBytes = new ALubyte[bytesCount];
-        testFile.seekg(0, std::ios::beg);
-        testFile.read((char *)fileBytes, bytesCount);
-        
-        playBuffer((void*)fileBytes, bytesCount, 4000);
+        std::ifstream pcmFile(fileName, std::ios::binary);
+        if (!pcmFile.is_open()) {
+            std::cout << "Could not open " << fileName << std::endl;
+        }
         
-        delete[] fileBytes;
+        // raw 8 bit mono at g_samplingFrequency, read one ring buffer at a time
+        playStream(SampleFormat::Unsigned8, [&](ALubyte *data, const int &capacity) {
+            pcmFile.read((char *)data, capacity);
+            return (int)pcmFile.gcount();
+        });
     }
     
     if (commandLineOptions.find("-playBitmap") != commandLineOptions.end()) {
         auto fileName = commandLineOptions["-playBitmap"];
-        std::ifstream bmpFile(fileName, std::ios::binary);
-        std::cout << "File is open: " << std::boolalpha << bmpFile.is_open() << std::endl;
-        
-        // compute file size in bytes
-        bmpFile.seekg(0, bmpFile.end);
-        int length = bmpFile.tellg();
-        bmpFile.seekg(0, bmpFile.beg);
-        std::cout << "File size: " << length << std::endl;
-        
-        // Header
-        std::uint16_t type = 0;
-        std::uint32_t sizeInBytes = 0;
-        std::uint32_t reserved_1 = 0;
-        std::uint32_t dataOffset = 0;
-        
-        bmpFile.read((char*)&type, sizeof(type)); // should be 16973
-        bmpFile.read((char*)&sizeInBytes, sizeof(sizeInBytes));
-        bmpFile.read((char*)&reserved_1, sizeof(reserved_1));
-        bmpFile.read((char*)&dataOffset, sizeof(dataOffset));
-        
-        // Info header
-        std::uint32_t infoHeaderSizeInBytes = 0;
-        std::int32_t width = 0;
-        std::int32_t height = 0;
-        
-        bmpFile.read((char*)&infoHeaderSizeInBytes, sizeof(infoHeaderSizeInBytes));
-        bmpFile.read((char*)&width, sizeof(width));
-        bmpFile.read((char*)&height, sizeof(height));
-        
-        if (height < 0) height = -height;
-        
-        
-        // read pixels
-        // line by line, each line is 4 byte aligned with zero bytes
-        bmpFile.seekg(dataOffset, bmpFile.beg);
-        std::vector<RGB> pixels;
-        const int pad = width % 4;
-        for (int y{}; y < height; ++y) {
-            for (int x{}; x < width; ++x) {
-                RGB rgb;
-                rgb.b = bmpFile.get();
-                rgb.g = bmpFile.get();
-                rgb.r = bmpFile.get();
-                pixels.emplace_back(rgb);
-            }
-            bmpFile.ignore(pad);
-        }
-        
-        // debug file
-        std::cout << "       Type: " << type << " " << ((char*)&type)[0] << ((char*)&type)[1] << std::endl;
-        std::cout << "SizeInBytes: " << sizeInBytes << std::endl;
-        std::cout << " reserved_1: " << reserved_1 << std::endl;
-        std::cout << " DataOffset: " << dataOffset << std::endl;
-        std::cout << "   infoSize: " << infoHeaderSizeInBytes << std::endl;
-        std::cout << "      width: " << width << std::endl;
-        std::cout << "     height: " << height << std::endl;
-        std::cout << std::endl;
-        std::cout << "pixel count: " << pixels.size() << std::endl;
-        std::cout << "pixel 0 = rgb(" << +pixels[0].r << "," << +pixels[0].g << "," << +pixels[0].b << ")" << std::endl;
-        
-        // Generate pcmData
-        std::cout << "Generate pcmData" << std::endl;
-        std::vector<ALubyte> pcmData;
         const int sizeFactor = 2;
-        for (int sample{}; sample < g_samplingFrequency*sizeFactor; ++sample) {
-            bool doDebug = sample % 100 == 0;
-            if (doDebug) { std::cout << "Debug sample loop: " << sample << std::endl; }
-            
-            std::vector<ALubyte> sampleValuesForCurrentSample;
-            for (int y{}; y < height; ++y) {
-                //std::cout << "Debug y loop: " << y << std::endl;
-                for (int x{}; x < width; ++x) {
-                    // std::cout << "Debug x loop: " << x << std::endl;
-                    RGB &rgb = pixels[y*width+x];
-                    if (rgb.r == 255 && rgb.g == 255 && rgb.b == 255) {
-                        continue;
-                    }
-                    float signalFrequency = x;
-                    if (signalFrequency == 0) {
-                        continue;
-                    }
-                    float amplitude = rgb.r / 255.0f;
-                    float phase = (y/height) * 1.f/signalFrequency; // TODO(moritz): think about phase handling that makes more sense
-                    float offset = 0.0f;
-                    if (rgb.g || rgb.b) {
-                        offset = (1.0f - amplitude) * (1.0f / (rgb.g + rgb.b));
-                    }
-                    // std::cout << "Computing sampleValue " << sample << ", " << x << ", " << y << std::endl;
-                    // TODO(moritz): Optimize loop: 
-                    //                 - currently the relevant pixels never change, 
-                    //                   collect them first before sampling
-                    //                 - presize vectors move up scope, they will be the same size for all samples
-                    ALubyte sampleValue = computeSampleValue(sample, g_samplingFrequency, amplitude, 
-                                                             signalFrequency, phase, offset, g_generator);
-                    sampleValuesForCurrentSample.emplace_back(sampleValue);
-                }
+        const int sampleCount = g_samplingFrequency*sizeFactor;
+        const int milliseconds = 4000;
+        const bool isStreamed = commandLineOptions.find("-streamRows") != commandLineOptions.end();
+        
+        // A drawing rendered before with the same settings plays straight from the cache
+        std::uint64_t cacheKey{};
+        const bool isCacheable = g_cacheByteLimit > 0 && pcmCacheKey(fileName, sampleCount, isStreamed, cacheKey);
+        if (!isCacheable || !playCachedPcm(cacheKey, sampleCount, milliseconds)) {
+            OscillatorBank bank;
+            const int stripRows = isStreamed ? std::max(1, std::atoi(commandLineOptions["-streamRows"].c_str())) : 0;
+            if (!compileBitmap(fileName, stripRows, bank)) {
+                return 1;
             }
-            std::uint32_t sum{};
-            for (const auto &sv : sampleValuesForCurrentSample) {
-                sum += sv;
+            
+            // play pcmData as it is generated
+            std::cout << "Play pcmData from Bitmap" << std::endl;
+            std::vector<ALubyte> pcmData;
+            playBankWhileRendering(bank, sampleCount, milliseconds, pcmData);
+            if (isCacheable && pcmData.size() == (std::size_t)sampleCount * bytesPerSample(g_sampleFormat)) {
+                storeCachedPcm(cacheKey, pcmData, sampleCount);
             }
-            sum /= sampleValuesForCurrentSample.size();
-            assert(sum < 256);
-            pcmData.emplace_back((ALubyte) sum);
         }
-        
-        // play pcmData
-        std::cout << "Play pcmData from Bitmap" << std::endl;
-        playBuffer((void*) pcmData.data(), g_samplingFrequency*sizeFactor, 4000);
-        
-        // TODO(moritz): Save generated Data as poor mans .pcm so that
-        //  a generate result can be replayed quickly.
-        
-        
-        
-        
     }
     
-    tearDownOpenAl();
+    if (commandLineOptions.find("-playMidi") != commandLineOptions.end()) {
+        if (!playMidiFile(commandLineOptions["-playMidi"])) {
+            return 1;
+        }
+    }
+    
+    if (commandLineOptions.find("-playScore") != commandLineOptions.end()) {
+        if (!playScoreFile(commandLineOptions["-playScore"])) {
+            return 1;
+        }
+    }
+    
+    // -scanBitmap plays the image left to right, -columnMilliseconds per column
+    if (commandLineOptions.find("-scanBitmap") != commandLineOptions.end()) {
+        auto fileName = commandLineOptions["-scanBitmap"];
+        const int columnMilliseconds = commandLineOptions.find("-columnMilliseconds") != commandLineOptions.end()
+                                     ? std::max(1, std::atoi(commandLineOptions["-columnMilliseconds"].c_str()))
+                                     : g_scanColumnMilliseconds;
+        Bitmap bitmap;
+        if (!decodeBitmap(fileName, bitmap)) {
+            return 1;
+        }
+        playScanline(bitmap, columnMilliseconds);
+    }
+    
+    sink->finish();
     return 0;
 }
\ No newline at end of file